@@ -3,7 +3,11 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/iosched.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* A block device. */
 struct block
@@ -19,6 +23,23 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue.  See submit(). */
+    struct lock io_lock;                /* Protects members below. */
+    struct condition io_done;           /* Signaled when a batch is done. */
+    struct list queue;                  /* Queued block_requests. */
+    bool busy;                          /* Is a transfer in progress? */
+    bool daemon_started;                /* Started block_daemon()? */
+    block_sector_t head;                /* Sector after last transfer. */
+
+    /* Request queue statistics. */
+    unsigned long long request_cnt;     /* Requests completed. */
+    unsigned long long dispatch_cnt;    /* Transfers issued to driver. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+    unsigned long long depth_sum;       /* Sum of depths seen at submit. */
+    size_t depth_max;                   /* Deepest queue seen. */
+    int64_t latency_sum;                /* Sum of request latencies. */
+    int64_t latency_max;                /* Longest request latency. */
   };
 
 /* List of all block devices. */
@@ -28,6 +49,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void submit (struct block *, block_sector_t,
+                    const struct block_iovec *, size_t, bool write);
+static void dispatch (struct block *);
+static void transfer (struct block *, block_sector_t,
+                      const struct block_iovec *, size_t, bool write);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +146,11 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.size = BLOCK_SECTOR_SIZE;
+  block_read_multiple (block, sector, &iov, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +161,399 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.size = BLOCK_SECTOR_SIZE;
+  block_write_multiple (block, sector, &iov, 1);
+}
+
+/* Returns the number of sectors covered by the IOV_CNT buffers
+   in IOV, checking that each is a whole number of sectors. */
+static block_sector_t
+iovec_sectors (const struct block_iovec *iov, size_t iov_cnt)
+{
+  block_sector_t sector_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    {
+      ASSERT (iov[i].size % BLOCK_SECTOR_SIZE == 0);
+      sector_cnt += iov[i].size / BLOCK_SECTOR_SIZE;
+    }
+  return sector_cnt;
+}
+
+/* Reads consecutive sectors starting at SECTOR from BLOCK into
+   the IOV_CNT buffers in IOV, filling each buffer in turn.  The
+   size of each buffer must be a multiple of BLOCK_SECTOR_SIZE.
+   Drivers that support it transfer all the sectors with as few
+   commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     const struct block_iovec *iov, size_t iov_cnt)
+{
+  submit (block, sector, iov, iov_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SECTOR to BLOCK from
+   the IOV_CNT buffers in IOV, taking each buffer in turn.  The
+   size of each buffer must be a multiple of BLOCK_SECTOR_SIZE.
+   Returns after the block device has acknowledged receiving all
+   the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const struct block_iovec *iov, size_t iov_cnt)
+{
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  submit (block, sector, iov, iov_cnt, true);
+}
+
+/* Request queue.
+
+   A thread doing I/O on a block device puts a request in the
+   device's queue and waits for it to complete.  Whenever the
+   device is idle, one of the waiting threads takes the request
+   the I/O scheduler picks, merges in queued requests for
+   adjacent sectors in the same direction, passes the whole batch
+   to the driver as one transfer, and then completes every
+   request in the batch.  That thread need not be the one that
+   submitted the request it dispatches.
+
+   Asynchronous requests, from block_submit(), have no waiting
+   thread to dispatch them, so the first one submitted to a
+   device starts a daemon thread that dispatches whenever the
+   device is idle and its queue is not empty. */
+
+/* Limits on the size of a merged transfer. */
+#define MERGE_MAX_SECTORS 128
+#define MERGE_MAX_IOV 16
+
+/* Signaled, with aio_lock held, whenever an asynchronous request
+   completes.  See block_wait_n(). */
+static struct lock aio_lock;
+static struct condition aio_done;
+
+static thread_func block_daemon NO_RETURN;
+
+/* Initializes request R to transfer the sectors starting at
+   SECTOR on BLOCK to or from the IOV_CNT buffers in IOV,
+   according to WRITE, and adds it to BLOCK's queue.  Returns
+   false, without queuing R, if there is nothing to transfer.
+   BLOCK's io_lock must be held. */
+static bool
+enqueue (struct block *block, struct block_request *r,
+         block_sector_t sector, const struct block_iovec *iov,
+         size_t iov_cnt, bool write)
+{
+  size_t depth;
+
+  ASSERT (lock_held_by_current_thread (&block->io_lock));
+
+  r->sector = sector;
+  r->sector_cnt = iovec_sectors (iov, iov_cnt);
+  r->iov = iov;
+  r->iov_cnt = iov_cnt;
+  r->write = write;
+  r->async = false;
+  r->done = false;
+  r->callback = NULL;
+  r->aux = NULL;
+  if (r->sector_cnt == 0)
+    return false;
+  check_sector (block, sector);
+  check_sector (block, sector + r->sector_cnt - 1);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+
+  r->submitted = timer_ticks ();
+  list_push_back (&block->queue, &r->elem);
+  depth = list_size (&block->queue);
+  block->depth_sum += depth;
+  if (depth > block->depth_max)
+    block->depth_max = depth;
+  return true;
+}
+
+/* Queues a request to transfer the sectors starting at SECTOR to
+   or from the IOV_CNT buffers in IOV, according to WRITE, and
+   waits for it to complete. */
+static void
+submit (struct block *block, block_sector_t sector,
+        const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  struct block_request r;
+
+  lock_acquire (&block->io_lock);
+  if (enqueue (block, &r, sector, iov, iov_cnt, write))
+    {
+      while (!r.done)
+        if (!block->busy)
+          dispatch (block);
+        else
+          cond_wait (&block->io_done, &block->io_lock);
+    }
+  lock_release (&block->io_lock);
+}
+
+/* Starts transferring the sectors starting at SECTOR on BLOCK to
+   or from the IOV_CNT buffers in IOV, according to WRITE, and
+   returns without waiting for the transfer to finish.  R, IOV
+   and the buffers must remain valid until it does.
+
+   On completion, CALLBACK, if non-null, is called with R and
+   AUX, from whichever thread dispatched the request.  It must
+   not sleep for long or do I/O on BLOCK; upping a semaphore is
+   typical.  Completion can also be awaited with block_wait() or
+   block_wait_n(), or tested with block_done(). */
+void
+block_submit (struct block *block, struct block_request *r,
+              block_sector_t sector, const struct block_iovec *iov,
+              size_t iov_cnt, bool write, block_done_func *callback,
+              void *aux)
+{
+  lock_acquire (&block->io_lock);
+  if (!block->daemon_started)
+    {
+      char name[sizeof block->name + 3];
+
+      snprintf (name, sizeof name, "io-%s", block->name);
+      if (thread_create (name, PRI_DEFAULT, block_daemon, block) == TID_ERROR)
+        PANIC ("%s: cannot start I/O daemon", block->name);
+      block->daemon_started = true;
+    }
+  if (enqueue (block, r, sector, iov, iov_cnt, write))
+    {
+      r->async = true;
+      r->callback = callback;
+      r->aux = aux;
+      cond_broadcast (&block->io_done, &block->io_lock);
+    }
+  else
+    {
+      r->done = true;
+      if (callback != NULL)
+        callback (r, aux);
+    }
+  lock_release (&block->io_lock);
+}
+
+/* Returns true if R, submitted with block_submit(), has
+   completed. */
+bool
+block_done (const struct block_request *r)
+{
+  return r->done;
+}
+
+/* Waits for R, submitted with block_submit(), to complete. */
+void
+block_wait (struct block_request *r)
+{
+  block_wait_n (&r, 1, 1);
+}
+
+/* Waits until at least N of the CNT requests in REQS, all
+   submitted with block_submit(), have completed.  Returns the
+   number that have completed. */
+size_t
+block_wait_n (struct block_request *reqs[], size_t cnt, size_t n)
+{
+  size_t done_cnt;
+
+  ASSERT (n <= cnt);
+
+  lock_acquire (&aio_lock);
+  for (;;)
+    {
+      size_t i;
+
+      done_cnt = 0;
+      for (i = 0; i < cnt; i++)
+        if (reqs[i]->done)
+          done_cnt++;
+      if (done_cnt >= n)
+        break;
+      cond_wait (&aio_done, &aio_lock);
+    }
+  lock_release (&aio_lock);
+  return done_cnt;
+}
+
+/* Dispatches asynchronous requests queued on BLOCK_. */
+static void
+block_daemon (void *block_)
+{
+  struct block *block = block_;
+
+  lock_acquire (&block->io_lock);
+  for (;;)
+    {
+      while (block->busy || list_empty (&block->queue))
+        cond_wait (&block->io_done, &block->io_lock);
+      dispatch (block);
+    }
+}
+
+/* Returns true if request B can be merged into a batch of
+   SECTOR_CNT sectors starting at SECTOR, in direction WRITE,
+   made of IOV_CNT buffers. */
+static bool
+can_merge (const struct block_request *b, block_sector_t sector,
+           block_sector_t sector_cnt, size_t iov_cnt, bool write)
+{
+  return (b->write == write
+          && (b->sector == sector + sector_cnt
+              || b->sector + b->sector_cnt == sector)
+          && sector_cnt + b->sector_cnt <= MERGE_MAX_SECTORS
+          && iov_cnt + b->iov_cnt <= MERGE_MAX_IOV);
+}
+
+/* Takes the next request from BLOCK's queue, as chosen by the I/O
+   scheduler, with any requests adjacent to it, and performs them
+   as one transfer.  BLOCK must be idle and its io_lock held; the
+   lock is released during the transfer and while completing
+   asynchronous requests. */
+static void
+dispatch (struct block *block)
+{
+  struct block_iovec iov[MERGE_MAX_IOV];
+  struct list batch;
+  struct list_elem *e, *next;
+  struct block_request *first;
+  block_sector_t sector, sector_cnt;
+  size_t iov_cnt, i;
+  bool write;
+
+  ASSERT (!block->busy);
+  ASSERT (!list_empty (&block->queue));
+
+  first = iosched->next (&block->queue, block->head);
+  list_remove (&first->elem);
+  list_init (&batch);
+  list_push_back (&batch, &first->elem);
+  sector = first->sector;
+  sector_cnt = first->sector_cnt;
+  iov_cnt = first->iov_cnt;
+  write = first->write;
+
+  /* Grow the batch at either end while a queued request fits. */
+  e = list_begin (&block->queue);
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *b = list_entry (e, struct block_request, elem);
+      if (can_merge (b, sector, sector_cnt, iov_cnt, write))
+        {
+          list_remove (e);
+          if (b->sector < sector)
+            {
+              list_push_front (&batch, &b->elem);
+              sector = b->sector;
+            }
+          else
+            list_push_back (&batch, &b->elem);
+          sector_cnt += b->sector_cnt;
+          iov_cnt += b->iov_cnt;
+          block->merge_cnt++;
+
+          /* The batch changed, so look again from the start. */
+          e = list_begin (&block->queue);
+        }
+      else
+        e = list_next (e);
+    }
+
+  /* Gather the batch's buffers in sector order. */
+  iov_cnt = 0;
+  for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+    {
+      struct block_request *b = list_entry (e, struct block_request, elem);
+      for (i = 0; i < b->iov_cnt; i++)
+        iov[iov_cnt++] = b->iov[i];
+    }
+
+  block->busy = true;
+  lock_release (&block->io_lock);
+  transfer (block, sector, iov, iov_cnt, write);
+  lock_acquire (&block->io_lock);
+  block->busy = false;
+
+  block->head = sector + sector_cnt;
+  block->dispatch_cnt++;
+  if (write)
+    block->write_cnt += sector_cnt;
+  else
+    block->read_cnt += sector_cnt;
+
+  /* Complete the synchronous requests, whose waiters check for
+     completion with io_lock held, and take them out of the
+     batch, since they may vanish as soon as io_lock is
+     released. */
+  for (e = list_begin (&batch); e != list_end (&batch); e = next)
+    {
+      struct block_request *b = list_entry (e, struct block_request, elem);
+      int64_t latency = timer_elapsed (b->submitted);
+
+      next = list_next (e);
+      block->request_cnt++;
+      block->latency_sum += latency;
+      if (latency > block->latency_max)
+        block->latency_max = latency;
+      if (!b->async)
+        {
+          list_remove (e);
+          b->done = true;
+        }
+    }
+  cond_broadcast (&block->io_done, &block->io_lock);
+
+  /* Complete the asynchronous requests.  A request's owner may
+     reuse it as soon as it is marked done. */
+  if (!list_empty (&batch))
+    {
+      lock_release (&block->io_lock);
+      for (e = list_begin (&batch); e != list_end (&batch); e = next)
+        {
+          struct block_request *b = list_entry (e, struct block_request, elem);
+
+          next = list_next (e);
+          if (b->callback != NULL)
+            b->callback (b, b->aux);
+          lock_acquire (&aio_lock);
+          b->done = true;
+          cond_broadcast (&aio_done, &aio_lock);
+          lock_release (&aio_lock);
+        }
+      lock_acquire (&block->io_lock);
+    }
+}
+
+/* Has BLOCK's driver transfer the sectors starting at SECTOR to
+   or from the IOV_CNT buffers in IOV, according to WRITE, using
+   its multiple-sector operation if it has one. */
+static void
+transfer (struct block *block, block_sector_t sector,
+          const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  size_t i, ofs;
+
+  if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, iov, iov_cnt);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, iov, iov_cnt);
+  else
+    for (i = 0; i < iov_cnt; i++)
+      for (ofs = 0; ofs < iov[i].size; ofs += BLOCK_SECTOR_SIZE)
+        {
+          uint8_t *buffer = (uint8_t *) iov[i].buffer + ofs;
+          if (write)
+            block->ops->write (block->aux, sector++, buffer);
+          else
+            block->ops->read (block->aux, sector++, buffer);
+        }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -174,6 +591,16 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->request_cnt > 0)
+            printf ("%s (%s): %llu requests in %llu transfers, "
+                    "%llu merged, queue depth avg %llu max %zu, "
+                    "latency avg %lld max %lld ticks (%s)\n",
+                    block->name, block_type_name (block->type),
+                    block->request_cnt, block->dispatch_cnt,
+                    block->merge_cnt,
+                    block->depth_sum / block->request_cnt, block->depth_max,
+                    block->latency_sum / (int64_t) block->request_cnt,
+                    block->latency_max, iosched->name);
         }
     }
 }
@@ -188,10 +615,18 @@ block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
 {
+  static bool aio_initialized;
   struct block *block = malloc (sizeof *block);
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
+  if (!aio_initialized)
+    {
+      lock_init (&aio_lock);
+      cond_init (&aio_done);
+      aio_initialized = true;
+    }
+
   list_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
@@ -200,6 +635,16 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->io_lock);
+  cond_init (&block->io_done);
+  list_init (&block->queue);
+  block->busy = false;
+  block->daemon_started = false;
+  block->head = 0;
+  block->request_cnt = block->dispatch_cnt = block->merge_cnt = 0;
+  block->depth_sum = 0;
+  block->depth_max = 0;
+  block->latency_sum = block->latency_max = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
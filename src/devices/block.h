@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -49,10 +51,51 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* One piece of a scatter-gather transfer: SIZE bytes at BUFFER.
+   SIZE must be a multiple of BLOCK_SECTOR_SIZE. */
+struct block_iovec
+  {
+    void *buffer;
+    size_t size;
+  };
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t,
+                          const struct block_iovec *, size_t iov_cnt);
+void block_write_multiple (struct block *, block_sector_t,
+                           const struct block_iovec *, size_t iov_cnt);
+
+/* Asynchronous I/O. */
+struct block_request;
+typedef void block_done_func (struct block_request *, void *aux);
+
+/* A block I/O request.  The caller of block_submit() provides the
+   storage, which must stay valid until the request completes, but
+   should treat the members as private. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in queue or batch. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t sector_cnt;          /* Number of sectors. */
+    const struct block_iovec *iov;      /* Buffers. */
+    size_t iov_cnt;                     /* Number of buffers. */
+    bool write;                         /* Write (true) or read (false)? */
+    bool async;                         /* Submitted by block_submit()? */
+    volatile bool done;                 /* Completed? */
+    int64_t submitted;                  /* Timer ticks at submission. */
+    block_done_func *callback;          /* Called on completion. */
+    void *aux;                          /* Passed to callback. */
+  };
+
+void block_submit (struct block *, struct block_request *, block_sector_t,
+                   const struct block_iovec *, size_t iov_cnt, bool write,
+                   block_done_func *, void *aux);
+bool block_done (const struct block_request *);
+void block_wait (struct block_request *);
+size_t block_wait_n (struct block_request *[], size_t cnt, size_t n);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -61,10 +104,18 @@ void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* A driver must provide READ and WRITE.  READ_MULTIPLE and
+   WRITE_MULTIPLE, which transfer consecutive sectors to or from
+   a vector of buffers, are optional: if they are null, the block
+   layer calls READ or WRITE once per sector instead. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t,
+                           const struct block_iovec *, size_t iov_cnt);
+    void (*write_multiple) (void *aux, block_sector_t,
+                            const struct block_iovec *, size_t iov_cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -3,15 +3,26 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus-master IDE controller, as in
+   QEMU and Bochs, sectors are transferred by DMA: the driver
+   queues each request on its channel and sleeps, the controller
+   copies the data to or from memory without the CPU, and the
+   completion interrupt wakes the requester and starts the next
+   queued request.  Otherwise the driver falls back to PIO, in
+   which the CPU copies every word through the data port. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +45,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +61,39 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus-master IDE port addresses, relative to a channel's
+   bus-master base, and their bits.  See the Intel PIIX
+   datasheet, "Bus Master IDE". */
+#define bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)     /* Status. */
+#define bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)       /* PRD table. */
+
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+
+/* A physical region descriptor, telling the bus master where in
+   physical memory one piece of a transfer goes.  A region must
+   not cross a PRD_BOUNDARY. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Bytes, or 0 for 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_BOUNDARY 0x10000    /* Regions may not cross multiples. */
+
+/* Number of PRD entries per channel. */
+#define PRD_CNT 32
+
+/* Most sectors transferred by one command. */
+#define IDE_MAX_SECTORS 128
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +102,28 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Does the device support DMA? */
+  };
+
+/* A physically contiguous piece of a DMA request's memory. */
+struct ide_region
+  {
+    uint32_t addr;              /* Physical address. */
+    uint32_t size;              /* Bytes, at most PRD_BOUNDARY. */
+  };
+
+/* A request queued for a DMA transfer of consecutive sectors. */
+struct ide_request
+  {
+    struct list_elem elem;      /* Element in channel's queue. */
+    struct ata_disk *d;         /* Disk to access. */
+    block_sector_t sec_no;      /* First sector to transfer. */
+    block_sector_t sec_cnt;     /* Number of sectors. */
+    struct ide_region regions[PRD_CNT]; /* Memory to transfer. */
+    size_t region_cnt;          /* Number of regions. */
+    bool write;                 /* True to write, false to read. */
+    bool ok;                    /* Set on completion: succeeded? */
+    struct semaphore done;      /* Up'd on completion. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +139,15 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* DMA.  If dma is true, every transfer on the channel goes
+       through the queue and lock is unused.  The queue and
+       active request are protected by disabling interrupts. */
+    bool dma;                   /* Use bus-master DMA? */
+    uint16_t bm_base;           /* Bus-master base port, or 0. */
+    struct list queue;          /* Waiting struct ide_requests. */
+    struct ide_request *active; /* Request in progress, if any. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (256)));
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +161,10 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t sec_cnt);
+static void set_sectors (struct ata_disk *, block_sector_t,
+                         block_sector_t sec_cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,12 +174,26 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static void ide_read_multiple (void *, block_sector_t,
+                               const struct block_iovec *, size_t);
+static void ide_write_multiple (void *, block_sector_t,
+                                const struct block_iovec *, size_t);
+static void pio_transfer (struct ata_disk *, block_sector_t,
+                          const struct block_iovec *, size_t, bool write);
+
+static uint16_t find_bus_master (void);
+static void dma_transfer (struct ata_disk *, block_sector_t,
+                          const struct block_iovec *, size_t, bool write);
+static void start_request (struct channel *);
+static void complete_request (struct channel *);
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +219,10 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->dma = false;
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      list_init (&c->queue);
+      c->active = NULL;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +233,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -152,8 +250,84 @@ ide_init (void)
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
+
+      /* Switch to DMA if the controller can do it and so can
+         every disk on the channel, since PIO and DMA requests
+         cannot be mixed on one channel. */
+      if (c->bm_base != 0)
+        {
+          c->dma = c->devices[0].is_ata || c->devices[1].is_ata;
+          for (dev_no = 0; dev_no < 2; dev_no++)
+            if (c->devices[dev_no].is_ata && !c->devices[dev_no].dma)
+              c->dma = false;
+          if (c->dma)
+            printf ("%s: using bus-master DMA\n", c->name);
+        }
     }
 }
+
+/* PCI configuration space. */
+
+#define PCI_CONFIG_ADDR 0xcf8   /* Configuration address port. */
+#define PCI_CONFIG_DATA 0xcfc   /* Configuration data port. */
+
+/* Returns the 32-bit register at byte offset REG in the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at byte offset REG in the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that drives the
+   legacy channels and can act as a bus master.  If one is
+   found, enables bus mastering and returns the base I/O port of
+   its bus-master registers.  Otherwise, returns 0. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4;
+
+        if ((pci_read_config (dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 01h (mass storage), subclass 01h (IDE), with
+           programming interface bit 7 (bus master) set and bits 0
+           and 2 (native-mode channels) clear. */
+        class = pci_read_config (dev, func, 0x08) >> 8;
+        if ((class >> 8) != 0x0101 || (class & 0x85) != 0x80)
+          continue;
+
+        /* BAR4 holds the bus-master base, which must be in I/O
+           space. */
+        bar4 = pci_read_config (dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space access and bus mastering. */
+        pci_write_config (dev, func, 0x04,
+                          pci_read_config (dev, func, 0x04) | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
 
 /* Disk detection and identification. */
 
@@ -281,9 +455,10 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
-  /* Calculate capacity.
+  /* Calculate capacity.  Check for DMA support.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -344,16 +519,11 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.size = BLOCK_SECTOR_SIZE;
+  ide_read_multiple (d_, sec_no, &iov, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,42 +533,354 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.size = BLOCK_SECTOR_SIZE;
+  ide_write_multiple (d_, sec_no, &iov, 1);
+}
+
+/* Reads consecutive sectors starting at SEC_NO from disk D into
+   the IOV_CNT buffers in IOV, using one command per
+   IDE_MAX_SECTORS sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no,
+                   const struct block_iovec *iov, size_t iov_cnt)
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+
+  if (d->channel->dma)
+    dma_transfer (d, sec_no, iov, iov_cnt, false);
+  else
+    pio_transfer (d, sec_no, iov, iov_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SEC_NO to disk D from
+   the IOV_CNT buffers in IOV, using one command per
+   IDE_MAX_SECTORS sectors.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no,
+                    const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct ata_disk *d = d_;
+
+  if (d->channel->dma)
+    dma_transfer (d, sec_no, iov, iov_cnt, true);
+  else
+    pio_transfer (d, sec_no, iov, iov_cnt, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
+/* Returns the number of sectors in the IOV_CNT buffers in IOV. */
+static block_sector_t
+iovec_sectors (const struct block_iovec *iov, size_t iov_cnt)
+{
+  block_sector_t sec_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    sec_cnt += iov[i].size / BLOCK_SECTOR_SIZE;
+  return sec_cnt;
+}
+
+/* PIO transfers. */
+
+/* Transfers consecutive sectors starting at SEC_NO between disk
+   D and the IOV_CNT buffers in IOV, in the direction given by
+   WRITE, with the CPU copying each sector through the data
+   port.  The disk interrupts once per sector. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  struct channel *c = d->channel;
+  block_sector_t sec_left = iovec_sectors (iov, iov_cnt);
+  block_sector_t cmd_left = 0;
+  size_t i, ofs;
+
+  lock_acquire (&c->lock);
+  for (i = 0; i < iov_cnt; i++)
+    for (ofs = 0; ofs < iov[i].size; ofs += BLOCK_SECTOR_SIZE)
+      {
+        uint8_t *buffer = (uint8_t *) iov[i].buffer + ofs;
+
+        if (cmd_left == 0)
+          {
+            cmd_left = sec_left < IDE_MAX_SECTORS ? sec_left : IDE_MAX_SECTORS;
+            select_sector (d, sec_no, cmd_left);
+            issue_pio_command (c, (write ? CMD_WRITE_SECTOR_RETRY
+                                   : CMD_READ_SECTOR_RETRY));
+          }
+
+        if (write)
+          {
+            if (!wait_while_busy (d))
+              PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                     d->name, sec_no);
+            output_sector (c, buffer);
+            sema_down (&c->completion_wait);
+          }
+        else
+          {
+            sema_down (&c->completion_wait);
+            if (!wait_while_busy (d))
+              PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                     d->name, sec_no);
+            input_sector (c, buffer);
+          }
+        sec_no++;
+        sec_left--;
+        cmd_left--;
+      }
+  lock_release (&c->lock);
+}
+
+/* DMA transfers. */
+
+/* Returns true if the IOV_CNT buffers in IOV can be handed to the
+   bus master directly, that is, if they are all word-aligned
+   kernel buffers. */
+static bool
+dma_capable (const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    if (!is_kernel_vaddr (iov[i].buffer)
+        || !is_kernel_vaddr ((uint8_t *) iov[i].buffer + iov[i].size - 1)
+        || (uintptr_t) iov[i].buffer % 2 != 0)
+      return false;
+  return true;
+}
+
+/* Appends the SIZE bytes at kernel address BUFFER to request R's
+   physical regions, merging with the previous region where they
+   are physically contiguous.  Regions never cross a 64 kB
+   boundary. */
+static void
+add_regions (struct ide_request *r, const uint8_t *buffer, size_t size)
+{
+  while (size > 0)
+    {
+      uint32_t addr = vtop (buffer);
+      uint32_t n = PRD_BOUNDARY - addr % PRD_BOUNDARY;
+      struct ide_region *last = (r->region_cnt > 0
+                                 ? &r->regions[r->region_cnt - 1] : NULL);
+
+      if (n > size)
+        n = size;
+      if (last != NULL
+          && last->addr + last->size == addr
+          && addr % PRD_BOUNDARY != 0)
+        last->size += n;
+      else
+        {
+          ASSERT (r->region_cnt < PRD_CNT);
+          r->regions[r->region_cnt].addr = addr;
+          r->regions[r->region_cnt].size = n;
+          r->region_cnt++;
+        }
+      buffer += n;
+      size -= n;
+    }
+}
+
+/* Queues request R on its disk's channel, sleeps until it
+   completes, and panics if it failed. */
+static void
+dma_submit (struct ide_request *r)
+{
+  struct channel *c = r->d->channel;
+  enum intr_level old_level;
+
+  r->ok = false;
+  sema_init (&r->done, 0);
+
+  old_level = intr_disable ();
+  list_push_back (&c->queue, &r->elem);
+  if (c->active == NULL)
+    start_request (c);
+  intr_set_level (old_level);
+
+  sema_down (&r->done);
+  if (!r->ok)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           r->d->name, r->write ? "write" : "read", r->sec_no);
+}
+
+/* Transfers consecutive sectors starting at SEC_NO between disk
+   D and the IOV_CNT buffers in IOV by DMA, in the direction
+   given by WRITE.  Each command covers as many sectors as fit
+   in IDE_MAX_SECTORS and one PRD table; for each, queues a
+   request on D's channel and sleeps until it completes.  If the
+   buffers are not suitable for DMA, the data goes through a
+   bounce buffer. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  struct ide_request r;
+  struct block_iovec bounce_iov;
+  const struct block_iovec *xfer_iov = iov;   /* Buffers the DMA uses. */
+  size_t xfer_cnt = iov_cnt;
+  uint8_t *bounce = NULL;
+  size_t i, ofs;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (!dma_capable (iov, iov_cnt))
+    {
+      bounce_iov.size = iovec_sectors (iov, iov_cnt) * BLOCK_SECTOR_SIZE;
+      bounce_iov.buffer = bounce = malloc (bounce_iov.size);
+      if (bounce == NULL)
+        PANIC ("%s: out of memory for DMA bounce buffer", d->name);
+      if (write)
+        for (i = ofs = 0; i < iov_cnt; ofs += iov[i++].size)
+          memcpy (bounce + ofs, iov[i].buffer, iov[i].size);
+      xfer_iov = &bounce_iov;
+      xfer_cnt = 1;
+    }
+
+  r.d = d;
+  r.write = write;
+  r.sec_no = sec_no;
+  r.sec_cnt = 0;
+  r.region_cnt = 0;
+  for (i = 0; i < xfer_cnt; i++)
+    for (ofs = 0; ofs < xfer_iov[i].size; ofs += BLOCK_SECTOR_SIZE)
+      {
+        /* A sector adds at most two regions.  Issue what we have
+           if it might not fit. */
+        if (r.sec_cnt == IDE_MAX_SECTORS || r.region_cnt + 2 > PRD_CNT)
+          {
+            dma_submit (&r);
+            r.sec_no += r.sec_cnt;
+            r.sec_cnt = 0;
+            r.region_cnt = 0;
+          }
+        add_regions (&r, (uint8_t *) xfer_iov[i].buffer + ofs,
+                     BLOCK_SECTOR_SIZE);
+        r.sec_cnt++;
+      }
+  if (r.sec_cnt > 0)
+    dma_submit (&r);
+
+  if (bounce != NULL)
+    {
+      if (!write)
+        for (i = ofs = 0; i < iov_cnt; ofs += iov[i++].size)
+          memcpy (iov[i].buffer, bounce + ofs, iov[i].size);
+      free (bounce);
+    }
+}
+
+/* Starts the request at the head of channel C's queue, which
+   must not be empty, on an idle channel.  Does not wait for
+   anything, so it may be called from the interrupt handler.
+   Interrupts must be off. */
+static void
+start_request (struct channel *c) 
+{
+  struct ide_request *r;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->active == NULL);
+  ASSERT (!list_empty (&c->queue));
+
+  r = list_entry (list_pop_front (&c->queue), struct ide_request, elem);
+  c->active = r;
+
+  /* Describe the request's memory to the bus master.  A region
+     size of 0 means 64 kB. */
+  for (i = 0; i < r->region_cnt; i++)
+    {
+      c->prdt[i].addr = r->regions[i].addr;
+      c->prdt[i].size = r->regions[i].size;
+      c->prdt[i].flags = i == r->region_cnt - 1 ? PRD_EOT : 0;
+    }
+
+  /* Program the bus master, leaving it stopped. */
+  outl (bm_prdt (c), vtop (c->prdt));
+  outb (bm_command (c), r->write ? 0 : BM_CMD_READ);
+  outb (bm_status (c), inb (bm_status (c)) | BM_STA_ERR | BM_STA_IRQ);
+
+  /* Select the sectors.  The channel is idle, because the last
+     request on it has completed, so there is no need to wait. */
+  set_sectors (r->d, r->sec_no, r->sec_cnt);
+
+  /* Issue the command and start the transfer. */
+  c->expecting_interrupt = true;
+  outb (reg_command (c), r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (bm_command (c), inb (bm_command (c)) | BM_CMD_START);
+}
+
+/* Finishes channel C's active request after its completion
+   interrupt, wakes up its requester, and starts the next queued
+   request, if any.  Called from the interrupt handler. */
+static void
+complete_request (struct channel *c) 
+{
+  struct ide_request *r = c->active;
+  uint8_t bm_sta, status;
+
+  bm_sta = inb (bm_status (c));
+  outb (bm_command (c), 0);                     /* Stop bus master. */
+  status = inb (reg_status (c));                /* Acknowledge interrupt. */
+  outb (bm_status (c), bm_sta | BM_STA_ERR | BM_STA_IRQ);
+
+  r->ok = (bm_sta & BM_STA_ERR) == 0 && (status & STA_ERR) == 0;
+  c->active = NULL;
+  c->expecting_interrupt = false;
+  sema_up (&r->done);
+
+  if (!list_empty (&c->queue))
+    start_request (c);
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and SEC_CNT to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no,
+               block_sector_t sec_cnt)
+{
+  select_device_wait (d);
+  set_sectors (d, sec_no, sec_cnt);
+}
+
+/* Writes SEC_NO and SEC_CNT to the sector selection registers of
+   D's channel, selecting D as a side effect, without waiting for
+   the channel to become idle. */
+static void
+set_sectors (struct ata_disk *d, block_sector_t sec_no,
+             block_sector_t sec_cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
-  
-  select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  ASSERT (sec_cnt > 0 && sec_cnt <= IDE_MAX_SECTORS);
+
+  outb (reg_device (c),
+        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  timer_ndelay (400);
+  outb (reg_nsect (c), sec_cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
-  outb (reg_device (c),
-        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -511,7 +993,9 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->active != NULL)
+          complete_request (c);
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
@@ -0,0 +1,87 @@
+#include "devices/iosched.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+
+/* I/O schedulers.
+
+   The block layer keeps each device's pending requests in a
+   queue in order of submission and, whenever the device becomes
+   idle, asks the current scheduler which one to send to the
+   driver next.  It then merges in any queued requests for
+   adjacent sectors. */
+
+/* Timer ticks a request may wait under the deadline scheduler
+   before it is served ahead of the sweep.  Reads get a shorter
+   deadline, because a thread usually waits for its reads but can
+   often let writes trail behind. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
+
+/* No-op scheduler: serves requests in order of submission. */
+static struct block_request *
+noop_next (struct list *queue, block_sector_t head UNUSED)
+{
+  return list_entry (list_front (queue), struct block_request, elem);
+}
+
+/* C-LOOK scheduler: sweeps the disk toward higher sectors,
+   serving the request closest ahead of HEAD, and when none is
+   left ahead jumps back to the lowest requested sector. */
+static struct block_request *
+clook_next (struct list *queue, block_sector_t head)
+{
+  struct block_request *ahead = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector >= head && (ahead == NULL || r->sector < ahead->sector))
+        ahead = r;
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+    }
+  return ahead != NULL ? ahead : lowest;
+}
+
+/* Deadline scheduler: like C-LOOK, but if the oldest request has
+   waited longer than its deadline, serves it first, so that a
+   busy region of the disk cannot starve requests elsewhere. */
+static struct block_request *
+deadline_next (struct list *queue, block_sector_t head)
+{
+  struct block_request *oldest;
+
+  oldest = list_entry (list_front (queue), struct block_request, elem);
+  if (timer_elapsed (oldest->submitted)
+      > (oldest->write ? WRITE_EXPIRE : READ_EXPIRE))
+    return oldest;
+  return clook_next (queue, head);
+}
+
+static const struct iosched schedulers[] =
+  {
+    {"noop", noop_next},
+    {"clook", clook_next},
+    {"deadline", deadline_next},
+  };
+
+/* The scheduler in use. */
+const struct iosched *iosched = &schedulers[2];
+
+/* Makes the scheduler called NAME the one in use.  Returns true
+   if successful, false if there is no such scheduler. */
+bool
+iosched_select (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (schedulers[i].name, name))
+      {
+        iosched = &schedulers[i];
+        return true;
+      }
+  return false;
+}
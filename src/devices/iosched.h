@@ -0,0 +1,23 @@
+#ifndef DEVICES_IOSCHED_H
+#define DEVICES_IOSCHED_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* An I/O scheduler. */
+struct iosched
+  {
+    const char *name;
+
+    /* Returns the request in QUEUE, which is in order of
+       submission and not empty, to dispatch next.  HEAD is the
+       sector just past the last request dispatched. */
+    struct block_request *(*next) (struct list *queue, block_sector_t head);
+  };
+
+extern const struct iosched *iosched;
+
+bool iosched_select (const char *name);
+
+#endif /* devices/iosched.h */
@@ -0,0 +1,411 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors held by the buffer cache. */
+#define CACHE_SIZE 128
+
+/* Milliseconds between write-behind passes. */
+#define WRITE_BEHIND_INTERVAL 1000
+
+/* A cached sector.
+
+   SECTOR, VALID, ACCESSED, PIN_CNT, and membership in cache_map
+   are protected by cache_lock.  DATA, DIRTY, and LOADING are
+   protected by the entry's own LOCK, which is held while data is
+   copied in or out of the entry and across the disk I/O that
+   fills or writes it back, but never while acquiring cache_lock.
+   An entry can only be reused while it is unpinned, and an
+   unpinned entry's LOCK is free, so its DIRTY and LOADING may
+   then also be read under cache_lock. */
+struct cache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in cache_map. */
+    block_sector_t sector;              /* Cached sector. */
+    bool valid;                         /* Holds a sector? */
+    bool accessed;                      /* Used since last clock pass? */
+    int pin_cnt;                        /* Threads using the entry. */
+    struct lock lock;                   /* Protects the members below. */
+    bool dirty;                         /* Modified since read? */
+    bool loading;                       /* Read-ahead may be in progress? */
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
+    struct block_iovec iov;             /* Describes data, for async I/O. */
+    struct block_request req;           /* Read-ahead or write-behind. */
+  };
+
+/* The cache itself, protected by cache_lock. */
+static struct cache_entry cache[CACHE_SIZE];
+static struct hash cache_map;           /* Valid entries, by sector. */
+static size_t clock_hand;               /* Next entry to consider. */
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when an entry
+                                           becomes unpinned. */
+
+/* Serializes cache_flush(), whose requests use the entries'
+   REQ members. */
+static struct lock flush_lock;
+
+/* Set by cache_done() to stop the write-behind thread. */
+static bool write_behind_stop;
+
+static thread_func write_behind_daemon NO_RETURN;
+
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, hash_elem);
+  return hash_int (c->sector);
+}
+
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, hash_elem)->sector
+          < hash_entry (b, struct cache_entry, hash_elem)->sector);
+}
+
+/* Initializes the buffer cache and starts its write-behind
+   thread. */
+void
+cache_init (void)
+{
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      cache[i].accessed = false;
+      cache[i].pin_cnt = 0;
+      lock_init (&cache[i].lock);
+      cache[i].dirty = false;
+      cache[i].loading = false;
+      cache[i].data = pages + i * BLOCK_SECTOR_SIZE;
+      cache[i].iov.buffer = cache[i].data;
+      cache[i].iov.size = BLOCK_SECTOR_SIZE;
+    }
+  hash_init (&cache_map, cache_hash, cache_less, NULL);
+  clock_hand = 0;
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  lock_init (&flush_lock);
+
+  thread_create ("write-behind", PRI_DEFAULT, write_behind_daemon, NULL);
+}
+
+/* Writes every dirty entry back to disk and stops the
+   write-behind thread.  Called at file system shutdown. */
+void
+cache_done (void)
+{
+  write_behind_stop = true;
+  cache_flush ();
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if SECTOR
+   is not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, hash_elem) : NULL;
+}
+
+/* Waits for any read-ahead into entry C to finish.
+   Must be called with C's lock held. */
+static void
+cache_finish_load (struct cache_entry *c)
+{
+  if (c->loading)
+    {
+      block_wait (&c->req);
+      c->loading = false;
+    }
+}
+
+/* Drops a pin on entry C.  Must be called with cache_lock
+   held. */
+static void
+cache_unpin (struct cache_entry *c)
+{
+  ASSERT (c->pin_cnt > 0);
+  if (--c->pin_cnt == 0)
+    cond_broadcast (&cache_unpinned, &cache_lock);
+}
+
+/* Waits for any read-ahead into unpinned entry C, then writes C
+   back to disk if it is dirty.  C stays in the cache.  Must be
+   called with cache_lock held, which is released during the
+   I/O. */
+static void
+cache_clean (struct cache_entry *c)
+{
+  c->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&c->lock);
+  cache_finish_load (c);
+  if (c->dirty)
+    {
+      c->dirty = false;
+      block_write (fs_device, c->sector, c->data);
+    }
+  lock_release (&c->lock);
+
+  lock_acquire (&cache_lock);
+  cache_unpin (c);
+}
+
+/* Chooses an entry to reuse with the clock algorithm and drops it
+   from the cache.  A dirty entry is written back first, without
+   evicting it, and considered again on a later pass.  Must be
+   called with cache_lock held, which may be released and
+   reacquired meanwhile, so the caller must check again whether
+   the sector it wants has been cached. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t scanned = 0;
+
+  for (;;)
+    {
+      struct cache_entry *c = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (++scanned > 2 * CACHE_SIZE)
+        {
+          /* Every entry is in use. */
+          cond_wait (&cache_unpinned, &cache_lock);
+          scanned = 0;
+        }
+      if (c->pin_cnt > 0)
+        continue;
+      if (!c->valid)
+        return c;
+      if (c->accessed)
+        c->accessed = false;
+      else if (c->dirty || c->loading)
+        cache_clean (c);
+      else
+        {
+          hash_delete (&cache_map, &c->hash_elem);
+          c->valid = false;
+          return c;
+        }
+    }
+}
+
+/* Returns the entry for SECTOR, bringing it into the cache if
+   necessary.  If READ is false, the caller is about to overwrite
+   the whole sector, so its old contents are not read from disk.
+   The entry is returned pinned and with its lock held; the
+   caller must pass it to cache_put() when done.  The disk read,
+   if any, is made without holding cache_lock. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool read)
+{
+  struct cache_entry *c;
+  bool fresh = false;
+
+  lock_acquire (&cache_lock);
+  c = cache_lookup (sector);
+  if (c == NULL)
+    {
+      c = cache_evict ();
+      if (cache_lookup (sector) != NULL)
+        c = cache_lookup (sector);
+      else
+        {
+          c->sector = sector;
+          c->valid = true;
+          c->dirty = false;
+          c->loading = false;
+          hash_insert (&cache_map, &c->hash_elem);
+          fresh = true;
+
+          /* Nobody else can hold the lock of an unpinned entry,
+             so this does not block, and other threads looking up
+             SECTOR wait for the read below. */
+          lock_acquire (&c->lock);
+        }
+    }
+  c->accessed = true;
+  c->pin_cnt++;
+  lock_release (&cache_lock);
+
+  if (fresh)
+    {
+      if (read)
+        block_read (fs_device, sector, c->data);
+      else
+        memset (c->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  else
+    {
+      lock_acquire (&c->lock);
+      cache_finish_load (c);
+    }
+  return c;
+}
+
+/* Releases entry C, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *c)
+{
+  lock_release (&c->lock);
+  lock_acquire (&cache_lock);
+  cache_unpin (c);
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes starting at byte OFFSET within SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int size, int offset)
+{
+  struct cache_entry *c;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  c = cache_get (sector, true);
+  memcpy (buffer, c->data + offset, size);
+  cache_put (c);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   OFFSET.  The data reaches the disk when the entry is evicted,
+   at the next write-behind pass, or at cache_done(). */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int size, int offset)
+{
+  struct cache_entry *c;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  c = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (c->data + offset, buffer, size);
+  c->dirty = true;
+  cache_put (c);
+}
+
+/* Starts reading SECTOR into the cache, if it is not already
+   cached, without waiting for the read to finish.  A later
+   access to the sector waits for it only if it is still in
+   progress. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (cache_lookup (sector) == NULL)
+    {
+      struct cache_entry *c = cache_evict ();
+      if (cache_lookup (sector) != NULL)
+        {
+          lock_release (&cache_lock);
+          return;
+        }
+      c->sector = sector;
+      c->valid = true;
+      c->dirty = false;
+      c->accessed = false;
+      c->loading = true;
+      hash_insert (&cache_map, &c->hash_elem);
+      block_submit (fs_device, &c->req, sector, &c->iov, 1, false,
+                    NULL, NULL);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes all dirty entries back to disk.  The writes are all
+   submitted at once, so that the disk's I/O scheduler can order
+   and merge them, and then awaited together.  The entries being
+   written stay pinned until their writes finish, but are
+   otherwise free for use meanwhile; one written to again is
+   marked dirty for the next flush. */
+void
+cache_flush (void)
+{
+  static struct cache_entry *pinned[CACHE_SIZE];
+  static struct block_request *reqs[CACHE_SIZE];
+  size_t pin_cnt = 0;
+  size_t req_cnt = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *c = &cache[i];
+      if (c->valid)
+        {
+          c->pin_cnt++;
+          pinned[pin_cnt++] = c;
+        }
+    }
+  lock_release (&cache_lock);
+
+  for (i = 0; i < pin_cnt; i++)
+    {
+      struct cache_entry *c = pinned[i];
+      bool dirty;
+
+      lock_acquire (&c->lock);
+      cache_finish_load (c);
+      dirty = c->dirty;
+      if (dirty)
+        {
+          c->dirty = false;
+          block_submit (fs_device, &c->req, c->sector, &c->iov, 1, true,
+                        NULL, NULL);
+          pinned[req_cnt] = c;
+          reqs[req_cnt++] = &c->req;
+        }
+      lock_release (&c->lock);
+
+      /* Only entries being written need to stay put. */
+      if (!dirty)
+        {
+          lock_acquire (&cache_lock);
+          cache_unpin (c);
+          lock_release (&cache_lock);
+        }
+    }
+  block_wait_n (reqs, req_cnt, req_cnt);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < req_cnt; i++)
+    cache_unpin (pinned[i]);
+  lock_release (&cache_lock);
+
+  lock_release (&flush_lock);
+}
+
+/* Periodically writes dirty entries back to disk, so that a crash
+   loses at most WRITE_BEHIND_INTERVAL ms of writes. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (WRITE_BEHIND_INTERVAL);
+      if (write_behind_stop)
+        thread_exit ();
+      cache_flush ();
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_done (void);
+void cache_read_at (block_sector_t, void *, int size, int offset);
+void cache_write_at (block_sector_t, const void *, int size, int offset);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
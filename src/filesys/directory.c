@@ -1,12 +1,24 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
-/* A directory. */
+/* A directory.
+
+   On disk, a directory is an open-addressing hash table of
+   `struct dir_entry' slots.  Slot 0 is a header whose
+   inode_sector member counts the slots that are in use or
+   deleted; the other slots are probed linearly starting from the
+   hash of a name.  A lookup stops at the first slot that has
+   never been used, so it reads only a few slots no matter how
+   large the directory is.  The table is rehashed once it is
+   three-quarters full, counting deleted slots; it doubles only
+   if more than half of its slots hold live entries. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
@@ -19,14 +31,69 @@ struct dir_entry
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool deleted;                       /* Was in use, now free? */
   };
 
+/* Minimum number of slots in a directory's hash table. */
+#define DIR_MIN_SLOTS 16
+
+/* Orders directory operations.  Lookups and readdir hold it
+   shared; adding and removing entries, which may rehash a whole
+   table, hold it exclusively.  File data is not covered, so
+   reading and writing open files never waits for it. */
+static struct rwlock dir_lock;
+
+/* Returns the number of hash slots in DIR, not counting the
+   header. */
+static size_t
+slot_cnt (const struct dir *dir)
+{
+  size_t cnt = inode_length (dir->inode) / sizeof (struct dir_entry);
+  return cnt > 0 ? cnt - 1 : 0;
+}
+
+/* Returns the byte offset of slot IDX, numbered from 0. */
+static off_t
+slot_ofs (size_t idx)
+{
+  return (idx + 1) * sizeof (struct dir_entry);
+}
+
+/* Reads or writes the count of used slots in DIR's header. */
+static size_t
+get_used_cnt (const struct dir *dir)
+{
+  struct dir_entry header;
+  if (inode_read_at (dir->inode, &header, sizeof header, 0) != sizeof header)
+    return 0;
+  return header.inode_sector;
+}
+
+static bool
+set_used_cnt (struct dir *dir, size_t used_cnt)
+{
+  struct dir_entry header;
+  memset (&header, 0, sizeof header);
+  header.inode_sector = used_cnt;
+  return inode_write_at (dir->inode, &header, sizeof header, 0)
+         == sizeof header;
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  rwlock_init (&dir_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  if (entry_cnt < DIR_MIN_SLOTS)
+    entry_cnt = DIR_MIN_SLOTS;
+  return inode_create (sector, (entry_cnt + 1) * sizeof (struct dir_entry));
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -93,24 +160,118 @@ lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t slots, idx, i;
+  off_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  /* Probe the hash table. */
+  slots = slot_cnt (dir);
+  if (slots == 0)
+    return false;
+  idx = hash_string (name) % slots;
+  for (i = 0; i < slots; i++, idx = (idx + 1) % slots)
+    {
+      ofs = slot_ofs (idx);
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+          || (!e.in_use && !e.deleted))
+        return false;
+      if (e.in_use && !strcmp (name, e.name))
+        goto found;
+    }
+  return false;
+
+ found:
+  if (ep != NULL)
+    *ep = e;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
+}
+
+/* Stores E in the first free slot of DIR's hash table, probing
+   from the hash of its name, and sets *OFSP to the slot's
+   offset.  Adds 1 to *USED_CNT if the slot had never been used.
+   Returns true if successful, false on failure. */
+static bool
+insert (struct dir *dir, const struct dir_entry *e, size_t *used_cnt,
+        off_t *ofsp)
+{
+  struct dir_entry slot;
+  size_t slots = slot_cnt (dir);
+  size_t idx, i;
+
+  if (slots == 0)
+    return false;
+  idx = hash_string (e->name) % slots;
+  for (i = 0; i < slots; i++, idx = (idx + 1) % slots)
+    {
+      off_t ofs = slot_ofs (idx);
+      if (inode_read_at (dir->inode, &slot, sizeof slot, ofs) != sizeof slot)
+        return false;
+      if (!slot.in_use)
+        {
+          if (!slot.deleted)
+            ++*used_cnt;
           *ofsp = ofs;
-        return true;
-      }
+          return inode_write_at (dir->inode, e, sizeof *e, ofs) == sizeof *e;
+        }
+    }
   return false;
 }
 
+/* Rehashes DIR's hash table, dropping deleted slots.  The table
+   doubles in size if more than half of its slots hold live
+   entries; otherwise, as when files are repeatedly created and
+   removed, it keeps its size and only the deleted slots are
+   reclaimed.  Returns true if successful, false on failure. */
+static bool
+rehash (struct dir *dir)
+{
+  size_t old_slots = slot_cnt (dir);
+  size_t new_slots;
+  struct dir_entry *entries, empty;
+  size_t used_cnt = 0;
+  size_t live_cnt = 0;
+  off_t size = old_slots * sizeof *entries;
+  size_t i;
+  bool success = true;
+  off_t ofs;
+
+  entries = malloc (size > 0 ? size : 1);
+  if (entries == NULL)
+    return false;
+  if (inode_read_at (dir->inode, entries, size, slot_ofs (0)) != size)
+    {
+      free (entries);
+      return false;
+    }
+
+  for (i = 0; i < old_slots; i++)
+    if (entries[i].in_use)
+      live_cnt++;
+  new_slots = (live_cnt + 1) * 2 > old_slots ? old_slots * 2 : old_slots;
+  if (new_slots < DIR_MIN_SLOTS)
+    new_slots = DIR_MIN_SLOTS;
+
+  /* Clear the table, enlarging it if needed, then put the live
+     entries back. */
+  memset (&empty, 0, sizeof empty);
+  for (i = 0; i < new_slots && success; i++)
+    success = (inode_write_at (dir->inode, &empty, sizeof empty,
+                               slot_ofs (i)) == sizeof empty);
+  for (i = 0; i < old_slots && success; i++)
+    if (entries[i].in_use)
+      success = insert (dir, &entries[i], &used_cnt, &ofs);
+  free (entries);
+
+  return success && set_used_cnt (dir, used_cnt);
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -124,10 +285,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_read (&dir_lock);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  rwlock_release_read (&dir_lock);
 
   return *inode != NULL;
 }
@@ -142,6 +305,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  size_t used_cnt;
   off_t ofs;
   bool success = false;
 
@@ -152,29 +316,33 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  rwlock_acquire_write (&dir_lock);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Keep the table at most three-quarters full, counting deleted
+     slots, so that probe sequences stay short and end at a
+     never-used slot. */
+  used_cnt = get_used_cnt (dir);
+  if ((used_cnt + 1) * 4 > slot_cnt (dir) * 3)
+    {
+      if (!rehash (dir))
+        goto done;
+      used_cnt = get_used_cnt (dir);
+    }
 
   /* Write slot. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = (insert (dir, &e, &used_cnt, &ofs)
+             && set_used_cnt (dir, used_cnt));
 
  done:
+  rwlock_release_write (&dir_lock);
   return success;
 }
 
@@ -192,6 +360,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_write (&dir_lock);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -201,8 +371,10 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry, leaving a tombstone so that probes
+     for other names continue past it. */
   e.in_use = false;
+  e.deleted = true;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
@@ -211,6 +383,7 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  rwlock_release_write (&dir_lock);
   inode_close (inode);
   return success;
 }
@@ -222,15 +395,19 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool success = false;
 
+  rwlock_acquire_read (&dir_lock);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  rwlock_release_read (&dir_lock);
+  return success;
 }
@@ -1,6 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
 /* An open file. */
@@ -9,6 +10,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    int ref_cnt;                /* Number of file_dup()s plus one. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +25,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ref_cnt = 1;
       return file;
     }
   else
@@ -41,12 +44,32 @@ file_reopen (struct file *file)
   return file_open (inode_reopen (file->inode));
 }
 
-/* Closes FILE. */
+/* Returns FILE itself, with one more reference.  Unlike
+   file_reopen(), the file's position is shared: reading or
+   writing through either reference moves it for both.  FILE is
+   only closed once file_close() has been called for every
+   reference. */
+struct file *
+file_dup (struct file *file) 
+{
+  enum intr_level old_level = intr_disable ();
+  file->ref_cnt++;
+  intr_set_level (old_level);
+  return file;
+}
+
+/* Closes FILE, once this is its last reference. */
 void
 file_close (struct file *file) 
 {
   if (file != NULL)
     {
+      enum intr_level old_level = intr_disable ();
+      bool last = --file->ref_cnt == 0;
+      intr_set_level (old_level);
+      if (!last)
+        return;
+
       file_allow_write (file);
       inode_close (file->inode);
       free (file); 
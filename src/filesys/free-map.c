@@ -1,13 +1,38 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Protects the free map and its index.  Held while the changed
+   part of the free map file is written back, so that file's
+   sectors are always written in allocation order. */
+static struct lock free_map_lock;
+
+/* Free-space index.  The free map is divided into groups of
+   GROUP_BITS sectors, each covered by one sector of the free map
+   file, and group_free[] counts the free sectors in each group,
+   so that an allocation can skip full groups without scanning
+   their bits.  group_first[] holds a hint for each group: none
+   of the group's sectors before it is free, so that a search
+   skips the allocated prefix of a partly full group. */
+#define GROUP_BITS (BLOCK_SECTOR_SIZE * 8)
+static size_t *group_free;           /* Free sectors per group. */
+static block_sector_t *group_first;  /* No free sector before this. */
+static size_t group_cnt;             /* Number of groups. */
+static block_sector_t next_sector;   /* Next-fit allocation cursor. */
+
+static void count_free (void);
+static void adjust_free (block_sector_t, size_t cnt, bool allocated);
+static block_sector_t scan_groups (block_sector_t goal, size_t cnt);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -15,38 +40,201 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_BITS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  group_first = malloc (group_cnt * sizeof *group_first);
+  if (group_free == NULL || group_first == NULL)
+    PANIC ("free map index creation failed");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  count_free ();
+  next_sector = 0;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Allocation is next-fit: the search
+   starts where the previous allocation left off.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (next_sector, cnt, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map, as close
+   after sector GOAL as possible, and stores the first into
+   *SECTORP.  Only the free map file sectors covering the
+   allocated bits are rewritten.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector;
+  bool success = false;
+
+  lock_acquire (&free_map_lock);
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  sector = scan_groups (goal, cnt);
+  if (sector == BITMAP_ERROR)
+    goto done;
+
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (free_map_file != NULL
+      && !bitmap_write_partial (free_map, free_map_file, sector, cnt,
+                                BLOCK_SECTOR_SIZE))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      goto done;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  adjust_free (sector, cnt, true);
+  next_sector = sector + cnt;
+  *sectorp = sector;
+  success = true;
+
+ done:
+  lock_release (&free_map_lock);
+  return success;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  adjust_free (sector, cnt, false);
+  bitmap_write_partial (free_map, free_map_file, sector, cnt,
+                        BLOCK_SECTOR_SIZE);
+  lock_release (&free_map_lock);
+}
+
+/* Returns the number of sectors in group G. */
+static size_t
+group_size (size_t g)
+{
+  size_t start = g * GROUP_BITS;
+  size_t end = start + GROUP_BITS;
+  return (end < bitmap_size (free_map) ? end : bitmap_size (free_map)) - start;
+}
+
+/* Recomputes every group's free count and first-free hint from
+   the free map. */
+static void
+count_free (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_BITS;
+      size_t end = start + group_size (g);
+      size_t sector;
+
+      group_free[g] = bitmap_count (free_map, start, group_size (g), false);
+      for (sector = start; sector < end; sector++)
+        if (!bitmap_test (free_map, sector))
+          break;
+      group_first[g] = sector;
+    }
+}
+
+/* Updates the group free counts and hints for CNT sectors
+   starting at SECTOR that were just ALLOCATED (or released, if
+   false). */
+static void
+adjust_free (block_sector_t sector, size_t cnt, bool allocated)
+{
+  while (cnt > 0)
+    {
+      size_t g = sector / GROUP_BITS;
+      size_t n = (g + 1) * GROUP_BITS - sector;
+      if (n > cnt)
+        n = cnt;
+      if (allocated)
+        {
+          group_free[g] -= n;
+          if (group_first[g] == sector)
+            group_first[g] = sector + n;
+        }
+      else
+        {
+          group_free[g] += n;
+          if (group_first[g] > sector)
+            group_first[g] = sector;
+        }
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns the first sector of a run of CNT free sectors, looking
+   first at or after GOAL, then wrapping around to the start of
+   the disk, or BITMAP_ERROR if there is no such run.  A group
+   with no free sectors is skipped in constant time.  Within a
+   group, the search starts at the group's first-free hint and
+   looks at each bit once, so the cost of an allocation grows
+   with the number of groups rather than the number of
+   sectors. */
+static block_sector_t
+scan_groups (block_sector_t goal, size_t cnt)
+{
+  size_t first = goal / GROUP_BITS;
+  size_t i;
+
+  if (cnt == 0 || cnt > GROUP_BITS)
+    {
+      /* Runs this long span groups; fall back to a full scan. */
+      size_t sector = bitmap_scan (free_map, goal, cnt, false);
+      return (sector != BITMAP_ERROR ? sector
+              : bitmap_scan (free_map, 0, cnt, false));
+    }
+
+  for (i = 0; i <= group_cnt; i++)
+    {
+      size_t g = (first + i) % group_cnt;
+      size_t start = group_first[g];
+      size_t end = g * GROUP_BITS + group_size (g);
+      size_t run = 0;
+      size_t sector;
+
+      if (group_free[g] == 0)
+        continue;
+
+      /* The goal's group is visited twice: from GOAL first, and
+         from its start after wrapping around. */
+      if (i == 0 && goal > start)
+        start = goal;
+      else
+        {
+          /* Sharpen the hint while we are at it. */
+          while (start < end && bitmap_test (free_map, start))
+            start++;
+          group_first[g] = start;
+        }
+
+      /* Look for a run that starts in this group.  It may end in
+         the next group. */
+      for (sector = start; sector < bitmap_size (free_map); sector++)
+        if (bitmap_test (free_map, sector))
+          {
+            run = 0;
+            if (sector >= end)
+              break;
+          }
+        else if (run == 0 && sector >= end)
+          break;
+        else if (++run == cnt)
+          return sector + 1 - cnt;
+    }
+  return BITMAP_ERROR;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,9 +246,12 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_free ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file.  Nothing is left to write: every
+   change has already been written as it was made, by
+   bitmap_write_partial(). */
 void
 free_map_close (void) 
 {
@@ -1,23 +1,38 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of direct, indirect and doubly indirect sector pointers
+   in an inode, and number of pointers in an index sector. */
+#define DIRECT_CNT 124
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest number of data sectors a single inode can address. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   A sector pointer of 0 means "not allocated": sector 0 always
+   holds the free map inode, so it is never a data sector. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Sector of data sector pointers. */
+    block_sector_t doubly_indirect;     /* Sector of indirect sectors. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -31,37 +46,291 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* See inode_write_at(). */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Allocates a sector as close after *GOAL as possible, fills it
+   with zeros and stores its number in *SECTORP.  Advances *GOAL
+   past the new sector, so that successive allocations for one
+   file tend to be contiguous.  Returns true if successful, false
+   if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *goal, block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (*goal, 1, sectorp))
+    return false;
+  cache_write_at (*sectorp, zeros, BLOCK_SECTOR_SIZE, 0);
+  *goal = *sectorp + 1;
+  return true;
+}
+
+/* Stores in *SECTORP the sector pointer held in *SLOT.  If the
+   slot is unallocated and GOAL is non-null, first allocates a
+   zeroed sector for it near *GOAL.  Returns true if *SECTORP is
+   now a valid sector, false otherwise. */
+static bool
+get_slot (block_sector_t *slot, block_sector_t *goal,
+          block_sector_t *sectorp)
+{
+  if (*slot == 0 && goal != NULL && !allocate_zeroed (goal, slot))
+    return false;
+  *sectorp = *slot;
+  return *slot != 0;
+}
+
+/* Like get_slot(), but for entry IDX of the index sector TABLE,
+   which is read and updated through the buffer cache. */
+static bool
+get_table_slot (block_sector_t table, size_t idx, block_sector_t *goal,
+                block_sector_t *sectorp)
+{
+  block_sector_t slot;
+  off_t ofs = idx * sizeof slot;
+
+  cache_read_at (table, &slot, sizeof slot, ofs);
+  if (slot == 0 && goal != NULL)
+    {
+      if (!allocate_zeroed (goal, &slot))
+        return false;
+      cache_write_at (table, &slot, sizeof slot, ofs);
+    }
+  *sectorp = slot;
+  return slot != 0;
+}
+
+/* Finds the sector holding data sector number IDX of DISK and
+   stores it in *SECTORP.  If that sector, or an index sector on
+   the way to it, is unallocated, allocates it near *GOAL if GOAL
+   is non-null and fails otherwise.  Costs at most two sector
+   reads.  Updates DISK in memory only; the caller must write it
+   back.  Returns true if successful, false on failure. */
+static bool
+index_to_sector (struct inode_disk *disk, size_t idx, block_sector_t *goal,
+                 block_sector_t *sectorp)
+{
+  block_sector_t table;
+
+  if (idx < DIRECT_CNT)
+    return get_slot (&disk->direct[idx], goal, sectorp);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return (get_slot (&disk->indirect, goal, &table)
+            && get_table_slot (table, idx, goal, sectorp));
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return (get_slot (&disk->doubly_indirect, goal, &table)
+            && get_table_slot (table, idx / PTRS_PER_SECTOR, goal, &table)
+            && get_table_slot (table, idx % PTRS_PER_SECTOR, goal,
+                               sectorp));
+  return false;
+}
+
+/* Releases the sectors in index sector TABLE, which is LEVEL
+   levels above the data (1 for an indirect sector), and TABLE
+   itself. */
+static void
+release_table (block_sector_t table, int level)
+{
+  block_sector_t slots[PTRS_PER_SECTOR];
+  size_t i;
+
+  if (table == 0)
+    return;
+  cache_read_at (table, slots, BLOCK_SECTOR_SIZE, 0);
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    if (slots[i] != 0)
+      {
+        if (level > 1)
+          release_table (slots[i], level - 1);
+        else
+          free_map_release (slots[i], 1);
+      }
+  free_map_release (table, 1);
+}
+
+/* Releases the sectors that slots FIRST and up of index sector
+   TABLE, which is LEVEL levels above the data, point to, and
+   clears those slots. */
+static void
+release_table_from (block_sector_t table, size_t first, int level)
+{
+  block_sector_t slots[PTRS_PER_SECTOR];
+  size_t i;
+
+  cache_read_at (table, slots, BLOCK_SECTOR_SIZE, 0);
+  for (i = first; i < PTRS_PER_SECTOR; i++)
+    if (slots[i] != 0)
+      {
+        if (level > 1)
+          release_table (slots[i], level - 1);
+        else
+          free_map_release (slots[i], 1);
+        slots[i] = 0;
+      }
+  cache_write_at (table, slots, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Releases data sector FIRST of DISK and every one after it,
+   along with the index sectors that only point to those, and
+   clears the pointers to them.  Used to undo a failed
+   inode_allocate(), so that DISK is left as it was. */
+static void
+release_from (struct inode_disk *disk, size_t first)
+{
+  const size_t indirect_base = DIRECT_CNT;
+  const size_t doubly_base = DIRECT_CNT + PTRS_PER_SECTOR;
+  size_t i;
+
+  for (i = first; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      {
+        free_map_release (disk->direct[i], 1);
+        disk->direct[i] = 0;
+      }
+
+  if (first <= indirect_base)
+    {
+      release_table (disk->indirect, 1);
+      disk->indirect = 0;
+    }
+  else if (first < doubly_base)
+    release_table_from (disk->indirect, first - indirect_base, 1);
+
+  if (first <= doubly_base)
+    {
+      release_table (disk->doubly_indirect, 2);
+      disk->doubly_indirect = 0;
+    }
+  else
+    {
+      size_t idx = first - doubly_base;
+      size_t outer = idx / PTRS_PER_SECTOR;
+      size_t inner = idx % PTRS_PER_SECTOR;
+      block_sector_t table;
+
+      /* The indirect sector that FIRST falls in keeps its slots
+         below FIRST; the ones after it go entirely. */
+      cache_read_at (disk->doubly_indirect, &table, sizeof table,
+                     outer * sizeof table);
+      if (inner > 0 && table != 0)
+        release_table_from (table, inner, 1);
+      release_table_from (disk->doubly_indirect,
+                          inner > 0 ? outer + 1 : outer, 2);
+    }
+}
+
+/* Allocates the data sectors DISK, the inode stored in sector
+   INODE_SECTOR, needs to grow to LENGTH bytes.  Every sector
+   below DISK's current length is already allocated.
+   Returns true if successful.  Returns false if the disk fills
+   up or LENGTH is too large, in which case the sectors allocated
+   so far are released again and DISK is unchanged. */
+static bool
+inode_allocate (struct inode_disk *disk, block_sector_t inode_sector,
+                off_t length)
+{
+  size_t sectors = bytes_to_sectors (length);
+  size_t first = bytes_to_sectors (disk->length);
+  block_sector_t goal = inode_sector + 1;
+  block_sector_t sector;
+  size_t i;
+
+  if (sectors > MAX_SECTORS)
+    return false;
+  if (first > 0 && index_to_sector (disk, first - 1, NULL, &sector))
+    goal = sector + 1;
+  for (i = first; i < sectors; i++)
+    if (!index_to_sector (disk, i, &goal, &sector))
+      {
+        release_from (disk, first);
+        return false;
+      }
+  return true;
+}
+
+/* Releases every sector allocated to DISK, other than the inode
+   sector itself. */
+static void
+inode_release (struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  release_table (disk->indirect, 1);
+  release_table (disk->doubly_indirect, 2);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  if (pos < inode->data.length
+      && index_to_sector (&inode->data, pos / BLOCK_SECTOR_SIZE, NULL,
+                          &sector))
+    return sector;
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.  Protected
+   by open_inodes_lock, which also protects every inode's
+   open_cnt. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Open-inode table statistics. */
+static unsigned long long open_calls;   /* Calls to inode_open(). */
+static unsigned long long open_hits;    /* ...that found the inode open. */
+static size_t open_peak;                /* Most inodes open at once. */
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+}
+
+/* Prints open-inode table statistics. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %llu opens, %llu already open, %zu open now, "
+          "%zu peak\n", open_calls, open_hits,
+          hash_size (&open_inodes), open_peak);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -84,20 +353,11 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (inode_allocate (disk_inode, sector, length)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          disk_inode->length = length;
+          cache_write_at (sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
           success = true; 
         } 
       free (disk_inode);
@@ -111,33 +371,58 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+  open_calls++;
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      open_hits++;
+      lock_release (&open_inodes_lock);
+      return inode; 
     }
 
+  lock_release (&open_inodes_lock);
+
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is read without open_inodes_lock, so
+     that opens of other inodes do not wait for the disk, and
+     before it is published, so that a concurrent opener never
+     sees it half-initialized. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rwlock);
+  cache_read_at (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+
+  /* Another thread may have opened the inode meanwhile. */
+  lock_acquire (&open_inodes_lock);
+  e = hash_insert (&open_inodes, &inode->elem);
+  if (e != NULL)
+    {
+      free (inode);
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      open_hits++;
+      lock_release (&open_inodes_lock);
+      return inode;
+    }
+  if (hash_size (&open_inodes) > open_peak)
+    open_peak = hash_size (&open_inodes);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +431,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +457,25 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      lock_release (&open_inodes_lock);
+      return;
+    }
 
-      free (inode); 
+  /* Remove from inode table and release lock. */
+  hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+ 
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      free_map_release (inode->sector, 1);
+      inode_release (&inode->data);
     }
+
+  free (inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -202,8 +495,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,100 +513,98 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      cache_read_at (sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Start fetching the sector a sequential reader will want next. */
+  if (bytes_read > 0 && offset < inode_length (inode))
+    cache_read_ahead (byte_to_sector (inode, offset));
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends the inode.
+
+   Writes within the file only change data sectors, whose cache
+   entries are updated atomically, so they hold the inode's lock
+   shared with readers and with each other.  Extending writes
+   change the index and the length, so they hold it exclusively. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t length;
+  bool exclusive;
+
+  /* The length only grows, so a write that fits now still fits
+     once the lock is held. */
+  exclusive = offset + size > inode_length (inode);
+  if (exclusive)
+    rwlock_acquire_write (&inode->rwlock);
+  else
+    rwlock_acquire_read (&inode->rwlock);
 
   if (inode->deny_write_cnt)
-    return 0;
+    goto done;
+
+  /* A write past end of file allocates the new sectors first,
+     then fills them, and only then publishes the new length.  If
+     the disk fills up, nothing is allocated and the write stops
+     at the old end of file. */
+  length = inode_length (inode);
+  if (exclusive && offset + size > length
+      && inode_allocate (&inode->data, inode->sector, offset + size))
+    length = offset + size;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      if (chunk_size <= 0
+          || !index_to_sector (&inode->data, offset / BLOCK_SECTOR_SIZE,
+                               NULL, &sector_idx))
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write_at (sector_idx, buffer + bytes_written, chunk_size,
+                      sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write_at (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+    }
+
+ done:
+  if (exclusive)
+    rwlock_release_write (&inode->rwlock);
+  else
+    rwlock_release_read (&inode->rwlock);
   return bytes_written;
 }
 
@@ -322,8 +613,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +625,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
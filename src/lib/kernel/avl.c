@@ -0,0 +1,301 @@
+/* AVL tree.
+
+   See avl.h for basic information. */
+
+#include "avl.h"
+#include "../debug.h"
+
+static int height (const struct avl_elem *);
+static void update_height (struct avl_elem *);
+static void replace_child (struct avl *, struct avl_elem *parent,
+                           struct avl_elem *old, struct avl_elem *new);
+static struct avl_elem *rotate_left (struct avl *, struct avl_elem *);
+static struct avl_elem *rotate_right (struct avl *, struct avl_elem *);
+static void rebalance (struct avl *, struct avl_elem *);
+static struct avl_elem *leftmost (struct avl_elem *);
+static void destroy_subtree (struct avl_elem *, avl_action_func *,
+                             void *aux);
+
+/* Initializes tree T to compare elements using LESS, given
+   auxiliary data AUX. */
+void
+avl_init (struct avl *t, avl_less_func *less, void *aux)
+{
+  t->elem_cnt = 0;
+  t->root = NULL;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Removes all the elements from T, calling DESTRUCTOR, if it is
+   non-null, on each of them.  DESTRUCTOR may deallocate the
+   memory used by the element, since the tree no longer refers to
+   it afterward. */
+void
+avl_destroy (struct avl *t, avl_action_func *destructor)
+{
+  if (destructor != NULL)
+    destroy_subtree (t->root, destructor, t->aux);
+  t->root = NULL;
+  t->elem_cnt = 0;
+}
+
+/* Inserts NEW into tree T and returns a null pointer, if no
+   equal element is already in the tree.  If an equal element is
+   already in the tree, returns it without inserting NEW. */
+struct avl_elem *
+avl_insert (struct avl *t, struct avl_elem *new)
+{
+  struct avl_elem *parent = NULL;
+  struct avl_elem **link = &t->root;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (new, parent, t->aux))
+        link = &parent->left;
+      else if (t->less (parent, new, t->aux))
+        link = &parent->right;
+      else
+        return parent;
+    }
+
+  new->parent = parent;
+  new->left = new->right = NULL;
+  new->height = 1;
+  *link = new;
+  t->elem_cnt++;
+  rebalance (t, parent);
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in tree T, or a null
+   pointer if no equal element exists in the tree. */
+struct avl_elem *
+avl_find (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *n = t->root;
+
+  while (n != NULL)
+    if (t->less (e, n, t->aux))
+      n = n->left;
+    else if (t->less (n, e, t->aux))
+      n = n->right;
+    else
+      return n;
+  return NULL;
+}
+
+/* Returns the greatest element of tree T that is less than or
+   equal to E, or a null pointer if every element is greater
+   than E. */
+struct avl_elem *
+avl_floor (struct avl *t, const struct avl_elem *e)
+{
+  struct avl_elem *n = t->root;
+  struct avl_elem *best = NULL;
+
+  while (n != NULL)
+    if (t->less (e, n, t->aux))
+      n = n->left;
+    else
+      {
+        best = n;
+        n = n->right;
+      }
+  return best;
+}
+
+/* Removes element E, which must be in tree T. */
+void
+avl_delete (struct avl *t, struct avl_elem *e)
+{
+  struct avl_elem *fix;
+
+  if (e->left != NULL && e->right != NULL)
+    {
+      /* Put E's successor, which has no left child, in E's
+         place. */
+      struct avl_elem *s = leftmost (e->right);
+
+      if (s->parent != e)
+        {
+          fix = s->parent;
+          fix->left = s->right;
+          if (s->right != NULL)
+            s->right->parent = fix;
+          s->right = e->right;
+          e->right->parent = s;
+        }
+      else
+        fix = s;
+      s->left = e->left;
+      e->left->parent = s;
+      s->height = e->height;
+      replace_child (t, e->parent, e, s);
+    }
+  else
+    {
+      fix = e->parent;
+      replace_child (t, e->parent, e, e->left != NULL ? e->left : e->right);
+    }
+
+  t->elem_cnt--;
+  rebalance (t, fix);
+}
+
+/* Returns the least element of tree T, or a null pointer if T is
+   empty. */
+struct avl_elem *
+avl_first (struct avl *t)
+{
+  return t->root != NULL ? leftmost (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest element. */
+struct avl_elem *
+avl_next (struct avl_elem *e)
+{
+  if (e->right != NULL)
+    return leftmost (e->right);
+  while (e->parent != NULL && e->parent->right == e)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+avl_size (struct avl *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+avl_empty (struct avl *t)
+{
+  return t->elem_cnt == 0;
+}
+
+/* Returns the height of the subtree rooted at E, which may be
+   null. */
+static int
+height (const struct avl_elem *e)
+{
+  return e != NULL ? e->height : 0;
+}
+
+/* Recomputes E's height from its children's. */
+static void
+update_height (struct avl_elem *e)
+{
+  int l = height (e->left);
+  int r = height (e->right);
+  e->height = (l > r ? l : r) + 1;
+}
+
+/* Makes NEW, which may be null, take OLD's place as PARENT's
+   child, or as the root of T if PARENT is null. */
+static void
+replace_child (struct avl *t, struct avl_elem *parent,
+               struct avl_elem *old, struct avl_elem *new)
+{
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+  if (new != NULL)
+    new->parent = parent;
+}
+
+/* Rotates the subtree rooted at E to the left and returns its
+   new root, E's former right child. */
+static struct avl_elem *
+rotate_left (struct avl *t, struct avl_elem *e)
+{
+  struct avl_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  replace_child (t, e->parent, e, r);
+  r->left = e;
+  e->parent = r;
+  update_height (e);
+  update_height (r);
+  return r;
+}
+
+/* Rotates the subtree rooted at E to the right and returns its
+   new root, E's former left child. */
+static struct avl_elem *
+rotate_right (struct avl *t, struct avl_elem *e)
+{
+  struct avl_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  replace_child (t, e->parent, e, l);
+  l->right = e;
+  e->parent = l;
+  update_height (e);
+  update_height (l);
+  return l;
+}
+
+/* Restores the balance of every subtree on the path from E, which
+   may be null, up to the root of T, after an insertion or
+   deletion below E. */
+static void
+rebalance (struct avl *t, struct avl_elem *e)
+{
+  while (e != NULL)
+    {
+      int balance;
+
+      update_height (e);
+      balance = height (e->left) - height (e->right);
+      if (balance > 1)
+        {
+          if (height (e->left->left) < height (e->left->right))
+            rotate_left (t, e->left);
+          e = rotate_right (t, e);
+        }
+      else if (balance < -1)
+        {
+          if (height (e->right->right) < height (e->right->left))
+            rotate_right (t, e->right);
+          e = rotate_left (t, e);
+        }
+      e = e->parent;
+    }
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static struct avl_elem *
+leftmost (struct avl_elem *e)
+{
+  ASSERT (e != NULL);
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Calls DESTRUCTOR on every element of the subtree rooted at E,
+   children before their parent.  The recursion is only as deep
+   as the tree is high. */
+static void
+destroy_subtree (struct avl_elem *e, avl_action_func *destructor,
+                 void *aux)
+{
+  if (e != NULL)
+    {
+      destroy_subtree (e->left, destructor, aux);
+      destroy_subtree (e->right, destructor, aux);
+      destructor (e, aux);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef __LIB_KERNEL_AVL_H
+#define __LIB_KERNEL_AVL_H
+
+/* AVL tree.
+
+   A binary search tree that keeps itself balanced, so that
+   searches, insertions and deletions take O(log n) time in the
+   worst case, and whose elements can be visited in order.
+
+   Like the hash table and the linked list, the tree does not use
+   dynamic allocation.  Each structure that can potentially be in
+   a tree must embed a struct avl_elem member, and all of the
+   tree functions operate on these `struct avl_elem's.  The
+   avl_entry macro converts a struct avl_elem back to the
+   structure that contains it.  Refer to lib/kernel/list.h for a
+   detailed explanation of the technique. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct avl_elem
+  {
+    struct avl_elem *parent;    /* Parent, or null for the root. */
+    struct avl_elem *left;      /* Lesser elements. */
+    struct avl_elem *right;     /* Greater elements. */
+    int height;                 /* Height of this subtree. */
+  };
+
+/* Converts pointer to tree element AVL_ELEM into a pointer to
+   the structure that AVL_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define avl_entry(AVL_ELEM, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) &(AVL_ELEM)->height            \
+                     - offsetof (STRUCT, MEMBER.height)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool avl_less_func (const struct avl_elem *a,
+                            const struct avl_elem *b,
+                            void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+   data AUX. */
+typedef void avl_action_func (struct avl_elem *e, void *aux);
+
+/* AVL tree. */
+struct avl
+  {
+    size_t elem_cnt;            /* Number of elements in tree. */
+    struct avl_elem *root;      /* Root, or null if empty. */
+    avl_less_func *less;        /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Basic life cycle. */
+void avl_init (struct avl *, avl_less_func *, void *aux);
+void avl_destroy (struct avl *, avl_action_func *);
+
+/* Search, insertion, deletion. */
+struct avl_elem *avl_insert (struct avl *, struct avl_elem *);
+struct avl_elem *avl_find (struct avl *, const struct avl_elem *);
+struct avl_elem *avl_floor (struct avl *, const struct avl_elem *);
+void avl_delete (struct avl *, struct avl_elem *);
+
+/* Traversal, in ascending order. */
+struct avl_elem *avl_first (struct avl *);
+struct avl_elem *avl_next (struct avl_elem *);
+
+/* Information. */
+size_t avl_size (struct avl *);
+bool avl_empty (struct avl *);
+
+#endif /* lib/kernel/avl.h */
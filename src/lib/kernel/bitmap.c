@@ -358,6 +358,32 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE only the BLOCK_SIZE-byte blocks of B that
+   contain bits START through START + CNT - 1, so that a small
+   change to a large bitmap costs a small write.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_partial (const struct bitmap *b, struct file *file,
+                      size_t start, size_t cnt, size_t block_size)
+{
+  off_t size = byte_cnt (b->bit_cnt);
+  off_t first, last;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+  ASSERT (block_size > 0);
+
+  if (cnt == 0)
+    return true;
+  first = start / CHAR_BIT / block_size * block_size;
+  last = ((start + cnt - 1) / CHAR_BIT / block_size + 1) * block_size;
+  if (last > size)
+    last = size;
+  return (file_write_at (file, (const uint8_t *) b->bits + first,
+                         last - first, first)
+          == last - first);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
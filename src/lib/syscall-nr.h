@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_MADVISE,                /* Give advice about paging. */
+    SYS_MLOCK,                  /* Lock pages into memory. */
+    SYS_MUNLOCK                 /* Unlock pages. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,51 @@
+/* Child process for lg-open-many test.
+   Keeps OPEN_CNT more files open, beyond those its ancestors
+   hold open, and runs the next level's child.  The deepest
+   level then opens and closes each of the files held open by
+   its ancestors, so that every open finds its inode among
+   LEVELS * OPEN_CNT open ones. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/lg-open-many.h"
+
+int
+main (int argc, const char *argv[]) 
+{
+  int fds[OPEN_CNT];
+  char name[16];
+  int level;
+  int i;
+
+  test_name = "child-opn-many";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  level = atoi (argv[1]);
+
+  open_files (level * OPEN_CNT, fds);
+  if (level + 1 < LEVELS)
+    {
+      char cmd_line[32];
+      pid_t child;
+
+      snprintf (cmd_line, sizeof cmd_line, "child-opn-many %d", level + 1);
+      CHECK ((child = exec (cmd_line)) != PID_ERROR,
+             "exec \"%s\"", cmd_line);
+      CHECK (wait (child) == 0, "wait for \"%s\"", cmd_line);
+    }
+  else
+    for (i = 0; i < level * OPEN_CNT; i++)
+      {
+        int fd;
+
+        file_name (i, name);
+        if ((fd = open (name)) < 2)
+          fail ("open \"%s\" failed", name);
+        close (fd);
+      }
+  close_files (fds);
+  return 0;
+}
@@ -0,0 +1,57 @@
+/* Child process for par-rw.
+   Creates file "dataN", where N is our child index, writes our
+   part of a random buffer into it in chunks, then reads the
+   file back READ_PASSES times, checking its contents each
+   time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/base/par-rw.h"
+#include "tests/lib.h"
+
+static char buf1[FILE_SIZE * CHILD_CNT];
+static char buf2[FILE_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  const char *data;
+  int child_idx;
+  int fd;
+  size_t ofs;
+  int pass;
+
+  test_name = "child-par-rw";
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "data%d", child_idx);
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+  data = buf1 + child_idx * FILE_SIZE;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    CHECK (write (fd, data + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+           "write %d bytes at offset %zu in \"%s\"",
+           CHUNK_SIZE, ofs, file_name);
+
+  for (pass = 0; pass < READ_PASSES; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+        CHECK (read (fd, buf2 + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+               "read %d bytes at offset %zu in \"%s\"",
+               CHUNK_SIZE, ofs, file_name);
+      compare_bytes (buf2, data, FILE_SIZE, 0, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,55 @@
+/* Creates a thousand files, then opens and closes every one of
+   them several times over, keeping a hundred of them open at a
+   time, to exercise the open-inode table with thousands of
+   opens.  Then keeps LEVELS * OPEN_CNT files open at once, more
+   than one process's descriptor table holds, by running a chain
+   of child processes that each keep OPEN_CNT of them open, and
+   opens each of them again with all of them open.  The kernel's
+   inode statistics at shutdown report how many of the opens
+   found their inode already open. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/lg-open-many.h"
+
+#define ROUNDS 3
+
+void
+test_main (void) 
+{
+  int fds[OPEN_CNT];
+  char name[16];
+  int round, i, j;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (i, name);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      msg ("open and close every file, round %d", round + 1);
+      for (i = 0; i < FILE_CNT; i += OPEN_CNT)
+        {
+          open_files (i, fds);
+          close_files (fds);
+        }
+    }
+
+  msg ("keep %d files open in %d processes", LEVELS * OPEN_CNT, LEVELS);
+  open_files (0, fds);
+  CHECK (wait (exec ("child-opn-many 1")) == 0, "wait for child");
+  close_files (fds);
+
+  msg ("reopen one file %d times", OPEN_CNT);
+  file_name (0, name);
+  for (j = 0; j < OPEN_CNT; j++)
+    if ((fds[j] = open (name)) < 2)
+      fail ("open \"%s\" failed", name);
+  close_files (fds);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-open-many) begin
+(lg-open-many) create 1000 files
+(lg-open-many) open and close every file, round 1
+(lg-open-many) open and close every file, round 2
+(lg-open-many) open and close every file, round 3
+(lg-open-many) keep 1000 files open in 10 processes
+(lg-open-many) wait for child
+(lg-open-many) reopen one file 100 times
+(lg-open-many) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+#ifndef TESTS_FILESYS_BASE_LG_OPEN_MANY_H
+#define TESTS_FILESYS_BASE_LG_OPEN_MANY_H
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+#define FILE_CNT 1000
+#define OPEN_CNT 100            /* Files one process keeps open. */
+#define LEVELS 10               /* Processes keeping files open. */
+
+static inline void
+file_name (int i, char name[16]) 
+{
+  snprintf (name, 16, "f%d", i);
+}
+
+/* Opens the OPEN_CNT files starting at file FIRST into FDS. */
+static inline void
+open_files (int first, int fds[OPEN_CNT]) 
+{
+  char name[16];
+  int j;
+
+  for (j = 0; j < OPEN_CNT; j++)
+    {
+      file_name (first + j, name);
+      fds[j] = open (name);
+      if (fds[j] < 2)
+        fail ("open \"%s\" failed", name);
+    }
+}
+
+/* Closes the OPEN_CNT files in FDS. */
+static inline void
+close_files (int fds[OPEN_CNT]) 
+{
+  int j;
+
+  for (j = 0; j < OPEN_CNT; j++)
+    close (fds[j]);
+}
+
+#endif /* tests/filesys/base/lg-open-many.h */
@@ -0,0 +1,19 @@
+/* Starts several processes that each write their own file and
+   then read it back many times, all at once.  None of them
+   touches another's file, so with per-file locking their I/O
+   proceeds in parallel; compare the "Timer:" line printed at
+   power-off to see how long the whole run took. */
+
+#include <syscall.h>
+#include "tests/filesys/base/par-rw.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+
+  exec_children ("child-par-rw", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
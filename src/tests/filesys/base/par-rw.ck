@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-rw) begin
+(par-rw) exec child 1 of 4: "child-par-rw 0"
+(par-rw) exec child 2 of 4: "child-par-rw 1"
+(par-rw) exec child 3 of 4: "child-par-rw 2"
+(par-rw) exec child 4 of 4: "child-par-rw 3"
+(par-rw) wait for child 1 of 4 returned 0 (expected 0)
+(par-rw) wait for child 2 of 4 returned 1 (expected 1)
+(par-rw) wait for child 3 of 4 returned 2 (expected 2)
+(par-rw) wait for child 4 of 4 returned 3 (expected 3)
+(par-rw) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BASE_PAR_RW_H
+#define TESTS_FILESYS_BASE_PAR_RW_H
+
+#define CHILD_CNT 4
+#define CHUNK_SIZE 512
+#define FILE_SIZE (CHUNK_SIZE * 32)
+#define READ_PASSES 8
+
+#endif /* tests/filesys/base/par-rw.h */
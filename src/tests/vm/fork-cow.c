@@ -0,0 +1,52 @@
+/* Forks a child that overwrites a 64 kB buffer it shares
+   copy-on-write with its parent, and verifies that each process
+   sees only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+/* Fails unless every byte of buf is C. */
+static void
+check_buf (char c)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("byte %zu is %#x, expected %#x", i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  int status;
+
+  memset (buf, 'p', sizeof buf);
+
+  child = fork ();
+  if (child == 0)
+    {
+      msg ("child sees parent's data");
+      check_buf ('p');
+      memset (buf, 'c', sizeof buf);
+      msg ("child sees its own writes");
+      check_buf ('c');
+      exit (42);
+    }
+
+  /* Print nothing until the child is done, so that the output
+     order does not depend on scheduling. */
+  if (child == PID_ERROR)
+    fail ("fork failed");
+  status = wait (child);
+  CHECK (status == 42, "wait for child (should return 42)");
+  check_buf ('p');
+  msg ("parent's data is unchanged");
+}
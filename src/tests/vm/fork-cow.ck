@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) child sees parent's data
+(fork-cow) child sees its own writes
+(fork-cow) wait for child (should return 42)
+(fork-cow) parent's data is unchanged
+(fork-cow) end
+EOF
+pass;
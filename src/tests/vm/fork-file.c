@@ -0,0 +1,46 @@
+/* Forks a child that reads from a file descriptor and writes to
+   a memory mapping inherited from its parent, and verifies that
+   the parent shares the descriptor's position but not the
+   mapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  char *map = ACTUAL;
+  char buf[10];
+  int handle;
+  pid_t child;
+  int status;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, map) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (read (handle, buf, sizeof buf) == sizeof buf,
+         "read \"sample.txt\"");
+  if (map[0] != sample[0])
+    fail ("mapping has bad data");
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Quiet in the child, as the parent checks the results. */
+      read (handle, buf, sizeof buf);
+      map[0] = ~sample[0];
+      exit (42);
+    }
+
+  if (child == PID_ERROR)
+    fail ("fork failed");
+  status = wait (child);
+  CHECK (status == 42, "wait for child (should return 42)");
+  CHECK (tell (handle) == 2 * sizeof buf,
+         "child's read moved the shared position");
+  CHECK (map[0] == sample[0], "child's write is not in parent's mapping");
+}
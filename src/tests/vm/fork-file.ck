@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-file) begin
+(fork-file) open "sample.txt"
+(fork-file) mmap "sample.txt"
+(fork-file) read "sample.txt"
+(fork-file) wait for child (should return 42)
+(fork-file) child's read moved the shared position
+(fork-file) child's write is not in parent's mapping
+(fork-file) end
+EOF
+pass;
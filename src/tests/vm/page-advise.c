@@ -0,0 +1,70 @@
+/* Exercises madvise(), mlock() and munlock() on a buffer in the
+   BSS.  Advice about the access pattern must not change what the
+   process reads; MADV_DONTNEED must return unlocked pages to
+   zeros but leave locked pages alone; and bad arguments must be
+   rejected. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 128
+
+static uint8_t buf[(PAGE_CNT + 1) * PAGE_SIZE];
+
+static void
+check (uint8_t *pages, size_t first, size_t cnt, bool zero)
+{
+  size_t i;
+
+  for (i = first; i < first + cnt; i++)
+    {
+      uint8_t expected = zero ? 0 : i + 1;
+      if (pages[i * PAGE_SIZE] != expected
+          || pages[i * PAGE_SIZE + PAGE_SIZE - 1] != expected)
+        fail ("page %zu holds %d, expected %d",
+              i, pages[i * PAGE_SIZE], expected);
+    }
+}
+
+void
+test_main (void)
+{
+  uint8_t *pages = (uint8_t *) (((uintptr_t) buf + PAGE_SIZE - 1)
+                                & ~(uintptr_t) (PAGE_SIZE - 1));
+  size_t len = PAGE_CNT * PAGE_SIZE;
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      pages[i * PAGE_SIZE] = i + 1;
+      pages[i * PAGE_SIZE + PAGE_SIZE - 1] = i + 1;
+    }
+
+  msg ("advise");
+  CHECK (madvise (pages, len, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (pages + 32 * PAGE_SIZE, 16 * PAGE_SIZE, MADV_RANDOM) == 0,
+         "madvise random");
+  CHECK (madvise (pages, len, MADV_WILLNEED) == 0, "madvise willneed");
+  check (pages, 0, PAGE_CNT, false);
+
+  msg ("lock");
+  CHECK (mlock (pages + 8 * PAGE_SIZE, 4 * PAGE_SIZE) == 0, "mlock");
+  CHECK (madvise (pages, 16 * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise dontneed");
+  check (pages, 0, 8, true);
+  check (pages, 8, 4, false);
+  check (pages, 12, 4, true);
+  CHECK (munlock (pages + 8 * PAGE_SIZE, 4 * PAGE_SIZE) == 0, "munlock");
+  check (pages, 16, PAGE_CNT - 16, false);
+
+  msg ("bad arguments");
+  if (madvise (pages + 1, PAGE_SIZE, MADV_NORMAL) != -1)
+    fail ("madvise accepted an unaligned address");
+  if (madvise (pages, PAGE_SIZE, 99) != -1)
+    fail ("madvise accepted bad advice");
+  if (mlock ((void *) 0x10000000, PAGE_SIZE) != -1)
+    fail ("mlock accepted an unmapped address");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-advise) begin
+(page-advise) advise
+(page-advise) madvise sequential
+(page-advise) madvise random
+(page-advise) madvise willneed
+(page-advise) lock
+(page-advise) mlock
+(page-advise) madvise dontneed
+(page-advise) munlock
+(page-advise) bad arguments
+(page-advise) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Touches the pages of a 256 kB initialized array from the last
+   one down to the first, so that most faults land in the middle
+   or at the end of a fault-around window, and checks that every
+   page was read in from the executable correctly. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (256 * 1024)
+#define PAGE_CNT (SIZE / 4096)
+
+static uint8_t buf[SIZE] = { 0x5a };
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("read every page backward");
+  for (i = PAGE_CNT; i-- > 0; )
+    if (buf[i * 4096 + 1] != 0)
+      fail ("page %zu is not zero", i);
+
+  msg ("write every page");
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * 4096 + 1] = i;
+
+  msg ("check every page backward");
+  for (i = PAGE_CNT; i-- > 0; )
+    if (buf[i * 4096 + 1] != (uint8_t) i)
+      fail ("page %zu holds %d, expected %zu", i, buf[i * 4096 + 1], i);
+  if (buf[0] != 0x5a)
+    fail ("first byte is %d, expected %d", buf[0], 0x5a);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-around) begin
+(page-around) read every page backward
+(page-around) write every page
+(page-around) check every page backward
+(page-around) end
+EOF
+pass;
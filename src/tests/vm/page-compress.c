@@ -0,0 +1,38 @@
+/* Fills 2 MB of memory, more than fits in physical memory, with
+   pages that compress well but are all different, then checks
+   them from the last page to the first, so that pages come back
+   from the compressed swap cache and from the swap disk. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (SIZE / 4096)
+
+static char buf[SIZE];
+
+/* Byte I of page P. */
+static char
+pattern (size_t p, size_t i)
+{
+  return i < 64 ? (char) (p * 7 + i) : (char) (p % 251);
+}
+
+void
+test_main (void)
+{
+  size_t p, i;
+
+  msg ("fill every page");
+  for (p = 0; p < PAGE_CNT; p++)
+    for (i = 0; i < 4096; i++)
+      buf[p * 4096 + i] = pattern (p, i);
+
+  msg ("check every page backward");
+  for (p = PAGE_CNT; p-- > 0; )
+    for (i = 0; i < 4096; i++)
+      if (buf[p * 4096 + i] != pattern (p, i))
+        fail ("byte %zu of page %zu is %d, expected %d",
+              i, p, buf[p * 4096 + i], pattern (p, i));
+}
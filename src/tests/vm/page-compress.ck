@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-compress) begin
+(page-compress) fill every page
+(page-compress) check every page backward
+(page-compress) end
+EOF
+pass;
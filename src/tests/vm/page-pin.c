@@ -0,0 +1,41 @@
+/* Writes a file from one buffer in the BSS and reads it back
+   into another that was never touched, so that every page of the
+   second must be brought in by read() itself before the file
+   system copies into it.  Then writes out a third buffer that was
+   never touched either, which reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (256 * 1024)
+
+static char src[SIZE], dst[SIZE], zeros[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    src[i] = i % 251;
+
+  CHECK (create ("pinned", SIZE), "create \"pinned\"");
+  CHECK ((handle = open ("pinned")) > 1, "open \"pinned\"");
+  CHECK (write (handle, src, SIZE) == SIZE, "write \"pinned\"");
+  seek (handle, 0);
+  CHECK (read (handle, dst, SIZE) == SIZE, "read \"pinned\"");
+  if (memcmp (src, dst, SIZE))
+    fail ("read data differs from written data");
+
+  seek (handle, 0);
+  CHECK (write (handle, zeros, SIZE) == SIZE, "write zeros");
+  seek (handle, 0);
+  CHECK (read (handle, dst, SIZE) == SIZE, "read zeros");
+  for (i = 0; i < SIZE; i++)
+    if (dst[i] != 0)
+      fail ("byte %zu is %d, not zero", i, dst[i]);
+  close (handle);
+}
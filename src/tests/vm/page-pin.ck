@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-pin) begin
+(page-pin) create "pinned"
+(page-pin) open "pinned"
+(page-pin) write "pinned"
+(page-pin) read "pinned"
+(page-pin) write zeros
+(page-pin) read zeros
+(page-pin) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Keeps using a small working set of 64 pages while scanning a
+   2 MB array once, so that a replacement policy that is not scan
+   resistant keeps evicting the working set.  Checks both. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_PAGES 64
+#define SCAN_SIZE (2 * 1024 * 1024)
+
+static uint8_t hot[HOT_PAGES * 4096];
+static uint8_t scan[SCAN_SIZE];
+
+void
+test_main (void)
+{
+  size_t i, p;
+
+  msg ("scan while touching the working set");
+  for (i = 0; i < SCAN_SIZE; i += 4096)
+    {
+      scan[i] = i / 4096;
+      for (p = 0; p < HOT_PAGES; p++)
+        hot[p * 4096] += 1;
+    }
+
+  msg ("check");
+  for (p = 0; p < HOT_PAGES; p++)
+    if (hot[p * 4096] != (uint8_t) (SCAN_SIZE / 4096))
+      fail ("hot page %zu holds %d", p, hot[p * 4096]);
+  for (i = 0; i < SCAN_SIZE; i += 4096)
+    if (scan[i] != (uint8_t) (i / 4096))
+      fail ("scanned page %zu holds %d", i / 4096, scan[i]);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-scan) begin
+(page-scan) scan while touching the working set
+(page-scan) check
+(page-scan) end
+EOF
+pass;
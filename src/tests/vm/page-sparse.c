@@ -0,0 +1,29 @@
+/* Uses a few pages scattered over a 64 MB uninitialized array.
+   Only the pages touched should cost the kernel any memory, so
+   this must start, run and exit as quickly as a small program. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024 * 1024)
+#define STRIDE (SIZE / 16)
+
+static uint8_t buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("write 16 pages");
+  for (i = 0; i < SIZE; i += STRIDE)
+    buf[i + 7] = i / STRIDE + 1;
+
+  msg ("check 16 pages");
+  for (i = 0; i < SIZE; i += STRIDE)
+    if (buf[i + 7] != i / STRIDE + 1 || buf[i + 8] != 0)
+      fail ("page at offset %zu holds %d", i, buf[i + 7]);
+  if (buf[SIZE - 1] != 0)
+    fail ("last byte is %d", buf[SIZE - 1]);
+}
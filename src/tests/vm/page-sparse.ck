@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-sparse) begin
+(page-sparse) write 16 pages
+(page-sparse) check 16 pages
+(page-sparse) end
+EOF
+pass;
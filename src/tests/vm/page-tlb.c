@@ -0,0 +1,41 @@
+/* Touches one byte in every page of a 3 MB buffer, many times
+   over, in an order that defeats the TLB.  The buffer does not
+   fit in memory alongside the kernel, so each pass also forces
+   evictions, whose clock sweeps clear accessed bits across the
+   whole working set.  Run time measures the cost of TLB
+   invalidation. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 1024 * 1024)
+#define PAGE_CNT (SIZE / 4096)
+#define ROUNDS 8
+
+/* Page visited at step I: a stride coprime to PAGE_CNT, so that
+   each pass visits every page exactly once, never two
+   neighbours in a row. */
+#define PAGE_AT(I) (((I) * 97) % PAGE_CNT)
+
+static uint8_t buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t round, i;
+
+  msg ("touch every page %d times", ROUNDS);
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < PAGE_CNT; i++)
+      buf[PAGE_AT (i) * 4096] += PAGE_AT (i) + 1;
+
+  msg ("check every page");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      uint8_t expect = (uint8_t) ((i + 1) * ROUNDS);
+      if (buf[i * 4096] != expect)
+        fail ("page %zu holds %d, expected %d",
+              i, buf[i * 4096], expect);
+    }
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-tlb) begin
+(page-tlb) touch every page 8 times
+(page-tlb) check every page
+(page-tlb) end
+EOF
+pass;
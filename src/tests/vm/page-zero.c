@@ -0,0 +1,37 @@
+/* Reads every page of a 4 MB zero-filled array, then writes a
+   few sparse pages and checks that only those changed.  Reads
+   of untouched pages are served by the shared zero page. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 1024 * 1024)
+#define PAGE_CNT (SIZE / 4096)
+#define STRIDE 64
+
+static uint8_t buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("read every page");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * 4096] != 0)
+      fail ("page %zu is not zero", i);
+
+  msg ("write every %dth page", STRIDE);
+  for (i = 0; i < PAGE_CNT; i += STRIDE)
+    buf[i * 4096 + 100] = 0x5a;
+
+  msg ("check every page");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      uint8_t expect = i % STRIDE == 0 ? 0x5a : 0;
+      if (buf[i * 4096 + 100] != expect)
+        fail ("page %zu holds %d, expected %d",
+              i, buf[i * 4096 + 100], expect);
+    }
+}
@@ -34,11 +34,14 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/iosched.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/policy.h"
+#include "vm/zswap.h"
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -56,11 +59,20 @@ static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
+/* -no-pse: Map kernel memory with 4 kB pages only? */
+static bool no_pse;
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -pageout-low, -pageout-high: Free frame watermarks for the
+   pageout daemon, in pages.  0 selects the default. */
+static size_t pageout_low;
+static size_t pageout_high;
+
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -130,7 +142,7 @@ main (void)
 #endif
 
   init_SwapTable();
-  FrameTable_init();
+  FrameTable_init(pageout_low, pageout_high);
 
   printf ("Boot complete.\n");
   
@@ -158,12 +170,20 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB of RAM is mapped with a
+   single 4 MB page, which saves a page table and takes one TLB
+   entry instead of 1,024.  The 4 MB that hold the kernel's code,
+   which is mapped read-only, and any partial 4 MB at the end of
+   RAM still get page tables. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  size_t large_pages = PTSPAN / PGSIZE;
+  bool pse = !no_pse && cpu_has_pse ();
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -176,6 +196,14 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && page + large_pages <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_kernel_large (vaddr, true);
+          page += large_pages - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -185,6 +213,16 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Enable 4 MB pages by setting CR4.PSE (bit 4) before the new
+     page directory goes into use.  See [IA32-v3a] 3.7.3 "Mixing
+     4-KByte and 4-MByte Pages". */
+  if (pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | (1 << 4)));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -193,6 +231,20 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages, as reported by
+   the PSE bit (bit 3 of EDX) of CPUID function 1.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  return (edx & (1 << 3)) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -252,6 +304,12 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !iosched_select (value))
+            PANIC ("unknown I/O scheduler `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -261,9 +319,27 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-no-pse"))
+        no_pse = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-pageout-low"))
+        pageout_low = atoi (value);
+      else if (!strcmp (name, "-pageout-high"))
+        pageout_high = atoi (value);
+      else if (!strcmp (name, "-fault-around"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pool_pages = atoi (value);
+      else if (!strcmp (name, "-vm-policy"))
+        {
+          if (value == NULL || !replace_policy_select (value))
+            PANIC ("unknown page replacement policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -378,14 +454,29 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -iosched=NAME      Schedule disk I/O with NAME: noop, clook,\n"
+          "                     or deadline (the default).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -no-pse            Map kernel memory with 4 kB pages only.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -pageout-low=COUNT Start paging out when fewer than COUNT\n"
+          "                     user frames are free.\n"
+          "  -pageout-high=COUNT\n"
+          "                     Page out until COUNT user frames are free.\n"
+          "  -fault-around=COUNT\n"
+          "                     Read in up to COUNT pages per page fault.\n"
+          "  -zswap=COUNT       Keep compressed swapped-out pages in COUNT\n"
+          "                     pages of kernel memory (0 to disable).\n"
+          "  -vm-policy=NAME    Replace pages with NAME: clock (the default),\n"
+          "                     wsclock, or 2q.\n"
 #endif
           );
   shutdown_power_off ();
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
@@ -39,12 +40,6 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 struct lock tid_lock;
 
-/*
-#ifdef USERPROG
-struct lock file_lock; // MYCODE
-#endif
-*/
-
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -207,6 +202,7 @@ thread_create (const char *name, int priority,
   sf->ebp = 0;
 
   init_SupplementalPageTable(&t->sp_table);
+  vma_init(&t->vm_areas);
 
   list_init(&t->mmf_lst);
   t->map_cnt = 0;
@@ -619,21 +615,15 @@ init_mmf(int id, struct file *file, void *upage)
   mmf->file = file;
 
   int max_size = file_length(file);
+  size_t page_cnt = DIV_ROUND_UP(max_size, PGSIZE);
+  struct vma *v;
 
-  for (off_t ofs = 0; ofs < max_size; ofs += PGSIZE)  {
-    if (get_spt_entry(&thread_current()->sp_table, upage + ofs))  return NULL;
-  }
+  if (vma_overlaps(upage, upage + page_cnt * PGSIZE))  return NULL;
 
-  for (off_t ofs = 0; ofs < max_size; ofs += PGSIZE)
-  {
-    if(ofs + PGSIZE < max_size) {
-      init_file_spt_entry(&thread_current()->sp_table, upage, file, ofs, PGSIZE, 0, true);
-      upage += PGSIZE;
-    }
-    else {
-      init_file_spt_entry(&thread_current()->sp_table, upage, file, ofs, max_size - ofs, PGSIZE - (max_size - ofs), true);
-      upage += PGSIZE;
-    }
+  if (page_cnt > 0) {
+    v = vma_add(upage, page_cnt, file, 0, max_size, true);
+    if (v == NULL)  return NULL;
+    v->mmap = true;
   }
 
   list_push_back(&thread_current ()->mmf_lst, &mmf->list_elem);
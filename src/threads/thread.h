@@ -7,6 +7,7 @@
 #include "threads/synch.h"
 #include "filesys/file.h"
 #include <hash.h>
+#include <avl.h>
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -108,6 +109,8 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int tlb_batch_depth;                /* Open pagedir_batch_begin()s. */
+    bool tlb_flush_pending;             /* TLB flush deferred by batch. */
     
     struct thread *parent;              /* Parent thread. */
     struct list children;               
@@ -123,6 +126,7 @@ struct thread
 #endif
 
     struct hash sp_table;
+    struct avl vm_areas;                /* struct vma, by start address. */
     struct list mmf_lst;
     int map_cnt;
     void *esp;
@@ -167,4 +171,7 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+struct mmf *init_mmf (int id, struct file *, void *upage);
+struct mmf *get_mmf (int mapid);
+
 #endif /* threads/thread.h */
@@ -5,7 +5,9 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/syscall.h"
 #include "vm/page.h"
+#include "vm/frame.h"
 #include "vm/swap.h"
 
 /* Number of page faults processed. */
@@ -153,25 +155,36 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  if(is_kernel_vaddr(fault_addr) || !not_present) exit(-1);
+  if(is_kernel_vaddr(fault_addr)) exit(-1);
 
   void* upage = pg_round_down(fault_addr);
   struct hash* current_spt = &thread_current()->sp_table;
+
+  /* A write to a present page is allowed only if the page is
+     copy-on-write, or is the shared zero page standing in for a
+     writable page, which then gets a frame of its own. */
+  if(!not_present) {
+    struct spt_entry *e = get_spt_entry(current_spt, upage);
+    if(!write || e == NULL) exit(-1);
+    if(e->cow && falloc_cow_break(e)) return;
+    if(e->state != IN_ZERO || !e->writable) exit(-1);
+    pagedir_clear_page(thread_current()->pagedir, upage);
+  }
   
-  if(PHYS_BASE - (int32_t)upage <= MAX_STACK_SIZE && !get_spt_entry(current_spt, upage))  {
+  if(PHYS_BASE - (int32_t)upage <= MAX_STACK_SIZE && !vma_find(upage))  {
    if(user) {
       if((int32_t)(f->esp) - (int32_t)fault_addr <= 128) {
-         init_zero_spt_entry(current_spt, upage);
+         if(!grow_stack(upage)) exit(-1);
       }
    }
    else {
       if((int32_t)(thread_current()->esp) - (int32_t)fault_addr <= 128) {
-         init_zero_spt_entry(current_spt, upage);
+         if(!grow_stack(upage)) exit(-1);
       }
    }
   }
 
-  if(load_a_page(current_spt, upage)) return;
+  if(load_a_page(current_spt, upage, write)) return;
 
   exit (-1);
 
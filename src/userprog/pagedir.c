@@ -5,9 +5,11 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void invalidate_page_batched (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -152,7 +154,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +182,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page_batched (pd, vpage);
         }
     }
 }
@@ -209,11 +211,27 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page_batched (pd, vpage);
         }
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  Used to make a page copy-on-write and back. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -243,21 +261,69 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   TLB entry.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for user virtual page
+   VPAGE if PD is the active page directory.  (If PD is not
+   active then its entries are not in the TLB, so there is no
+   need to invalidate anything.)  Unlike reloading CR3, INVLPG
+   leaves the rest of the TLB intact.  See [IA32-v3a] 3.12
+   "Translation Lookaside Buffers (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
   if (active_pd () == pd) 
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
+
+/* Like invalidate_page(), but if the running thread is inside a
+   pagedir_batch_begin()/pagedir_batch_end() pair, only notes
+   that a flush is needed and leaves it to pagedir_batch_end().
+
+   Only clearing the accessed and dirty bits may be deferred this
+   way: a stale TLB entry then merely delays the CPU setting the
+   bit again.  A page that is no longer present must always be
+   invalidated at once. */
+static void
+invalidate_page_batched (uint32_t *pd, const void *vpage) 
+{
+  struct thread *t = thread_current ();
+
+  if (t->tlb_batch_depth > 0)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      if (active_pd () == pd)
+        t->tlb_flush_pending = true;
+    }
+  else
+    invalidate_page (pd, vpage);
+}
+
+/* Starts a batch of accessed and dirty bit updates in the
+   running thread.  Until the matching pagedir_batch_end(), the
+   TLB is not invalidated for each update.  Batches may nest. */
+void
+pagedir_batch_begin (void) 
+{
+  thread_current ()->tlb_batch_depth++;
+}
+
+/* Ends a batch started by pagedir_batch_begin().  When the
+   outermost batch ends, flushes the TLB once if any update made
+   during the batch needs it. */
+void
+pagedir_batch_end (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch_depth > 0);
+  if (--t->tlb_batch_depth == 0 && t->tlb_flush_pending)
+    {
+      t->tlb_flush_pending = false;
+
+      /* Re-activating the active page directory clears the TLB. */
+      pagedir_activate (active_pd ());
+    }
 }
@@ -14,12 +14,15 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
+#include "vm/frame.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load(const char *cmdline, void (**eip)(void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -159,6 +162,151 @@ start_process(void *file_name_)
   NOT_REACHED();
 }
 
+/* Passes the parent's state from process_fork() to the child. */
+struct fork_args
+{
+  struct intr_frame if_;        /* Parent's user context at fork(). */
+  struct thread *parent;
+  struct semaphore done;        /* Upped once the child is set up. */
+  bool success;
+};
+
+/* Creates a copy of the running process that resumes from the
+   user context in F, with fork() returning 0 in the copy.
+   Memory is shared copy-on-write rather than copied.  Open file
+   descriptors are shared, along with their positions, as in
+   POSIX.  Memory mappings are not shared: each process gets a
+   private view of the mapped file, which does not see the other
+   process's writes to pages it already has in memory.  Returns the new process's thread id, or
+   TID_ERROR if it cannot be created. */
+tid_t process_fork(struct intr_frame *f)
+{
+  struct fork_args args;
+  tid_t tid;
+
+  args.if_ = *f;
+  args.parent = thread_current();
+  sema_init(&args.done, 0);
+  args.success = false;
+
+  tid = thread_create(thread_name(), PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down(&args.done);
+
+  if (!args.success)
+  {
+    /* Reap the failed child. */
+    process_wait(tid);
+    return TID_ERROR;
+  }
+  return tid;
+}
+
+/* Returns the child's copy of PARENT's file FILE, for
+   fork_SupplementalPageTable(). */
+static struct file *
+fork_map_file(struct file *file, void *parent_)
+{
+  struct thread *parent = parent_;
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+
+  if (file == parent->current_file)
+    return cur->current_file;
+  for (e = list_begin(&parent->mmf_lst); e != list_end(&parent->mmf_lst); e = list_next(e))
+  {
+    struct mmf *mmf = list_entry(e, struct mmf, list_elem);
+    if (mmf->file == file)
+    {
+      struct mmf *copy = get_mmf(mmf->id);
+      return copy != NULL ? copy->file : NULL;
+    }
+  }
+  return NULL;
+}
+
+/* Gives the running process PARENT's open files, which it
+   shares, and its own copies of PARENT's executable and memory
+   mappings. */
+static bool
+fork_files(struct thread *parent)
+{
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+
+  for (int i = 3; i < 128; i++)
+  {
+    if (parent->fd_list[i] == NULL)
+      continue;
+    cur->fd_list[i] = file_dup(parent->fd_list[i]);
+  }
+
+  if (parent->current_file != NULL)
+  {
+    cur->current_file = file_reopen(parent->current_file);
+    if (cur->current_file == NULL)
+      return false;
+    file_deny_write(cur->current_file);
+  }
+
+  for (e = list_begin(&parent->mmf_lst); e != list_end(&parent->mmf_lst); e = list_next(e))
+  {
+    struct mmf *mmf = list_entry(e, struct mmf, list_elem);
+    struct mmf *copy = malloc(sizeof *copy);
+    if (copy == NULL)
+      return false;
+    copy->id = mmf->id;
+    copy->upage = mmf->upage;
+    copy->file = file_reopen(mmf->file);
+    if (copy->file == NULL)
+    {
+      free(copy);
+      return false;
+    }
+    list_push_back(&cur->mmf_lst, &copy->list_elem);
+  }
+  cur->map_cnt = parent->map_cnt;
+  return true;
+}
+
+/* A thread function that makes the running thread a copy of the
+   process that called process_fork(), then starts it running. */
+static void
+start_fork(void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *cur = thread_current();
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+
+  cur->pagedir = pagedir_create();
+  if (cur->pagedir == NULL)
+    goto fail;
+  process_activate();
+
+  if (!fork_files(parent)
+      || !fork_SupplementalPageTable(parent, fork_map_file, parent))
+    goto fail;
+
+  args->success = true;
+  sema_up(&args->done);
+
+  asm volatile("movl %0, %%esp; jmp intr_exit"
+               :
+               : "g"(&if_)
+               : "memory");
+  NOT_REACHED();
+
+fail:
+  cur->exit_status = -1;
+  sema_up(&args->done);
+  thread_exit();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -526,23 +674,28 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
-  file_seek(file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0)
+  /* Adjacent segments may share a page; it stays with the
+     segment that claimed it first. */
+  while ((read_bytes > 0 || zero_bytes > 0) && vma_find(upage) != NULL)
   {
-    /* Calculate how to fill this page.
-       We will read PAGE_READ_BYTES bytes from FILE
-       and zero the final PAGE_ZERO_BYTES bytes. */
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-    size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-    init_file_spt_entry(&thread_current()->sp_table, upage, file, ofs, page_read_bytes, page_zero_bytes, writable);
-
-    /* Advance. */
     read_bytes -= page_read_bytes;
-    zero_bytes -= page_zero_bytes;
+    zero_bytes -= PGSIZE - page_read_bytes;
     upage += PGSIZE;
     ofs += page_read_bytes;
   }
+  if (read_bytes == 0 && zero_bytes == 0)
+    return true;
+
+  /* The rest of the segment is one VMA.  Its pages are set up
+     one at a time as they are first faulted in. */
+  struct vma *v = vma_add(upage, (read_bytes + zero_bytes) / PGSIZE, file, ofs, read_bytes, writable);
+  if (v == NULL)
+    return false;
+
+  /* Read-only pages are the same in every process running
+     this executable, so they share one frame. */
+  v->shared = !writable;
   return true;
 }
 
@@ -559,13 +712,24 @@ setup_stack(void **esp)
   if (kpage != NULL)
   {
     success = install_page(((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
+    if (success && vma_add(((uint8_t *)PHYS_BASE) - PGSIZE, 1, NULL, 0, 0, true) == NULL)
+    {
+      pagedir_clear_page(thread_current()->pagedir, ((uint8_t *)PHYS_BASE) - PGSIZE);
+      success = false;
+    }
+    struct spt_entry *e = NULL;
     if (success)
+      e = init_frame_spt_entry(&thread_current()->sp_table, PHYS_BASE - PGSIZE, kpage);
+    if (e != NULL)
     {
-      init_frame_spt_entry(&thread_current()->sp_table, PHYS_BASE - PGSIZE, kpage);
+      falloc_unpin_page(kpage, e);
       *esp = PHYS_BASE; // initialize sp
     }
     else
+    {
+      success = false;
       falloc_free_page(kpage);
+    }
   }
   return success;
 }
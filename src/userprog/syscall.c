@@ -9,11 +9,16 @@
 #include "filesys/file.h"
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "userprog/process.h"
 #include "vm/page.h"
+#include "vm/frame.h"
 
 struct file *find_f (int fd); //to find file by fd
 static void syscall_handler (struct intr_frame *f);
-struct lock file_lock;
+static int file_io (struct file *f, void *buffer, unsigned size, bool read);
+
+/* Largest piece of a read() or write() buffer pinned at once. */
+#define PIN_CHUNK (16 * PGSIZE)
 
 bool check_user_vaddr(void *addr)
 {
@@ -24,7 +29,6 @@ void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init (&file_lock);
 }
 
 void
@@ -35,6 +39,8 @@ syscall_handler (struct intr_frame *f)
     exit (-1);
   }
   void *sp = f->esp;
+  /* For faults and stack growth in the kernel on the user's behalf. */
+  thread_current()->esp = f->esp;
   //arguemnt require ==> change to right data type
   //if return value ==> to eax
   switch (*(uint32_t *)sp)
@@ -118,6 +124,29 @@ syscall_handler (struct intr_frame *f)
       if (!check_user_vaddr((int*)sp + 1)) exit(-1);
       munmap((int)*(uint32_t *)(sp + 4));
       break;
+
+    case SYS_FORK:
+      f->eax = process_fork(f);
+      break;
+
+    case SYS_MADVISE:
+      if (!check_user_vaddr((int*)sp + 1)) exit(-1);
+      if (!check_user_vaddr((int*)sp + 2)) exit(-1);
+      if (!check_user_vaddr((int*)sp + 3)) exit(-1);
+      f->eax = madvise((void *)*(uint32_t *)(sp + 4), (size_t)*(uint32_t *)(sp + 8), (int)*(uint32_t *)(sp + 12));
+      break;
+
+    case SYS_MLOCK:
+      if (!check_user_vaddr((int*)sp + 1)) exit(-1);
+      if (!check_user_vaddr((int*)sp + 2)) exit(-1);
+      f->eax = mlock((const void *)*(uint32_t *)(sp + 4), (size_t)*(uint32_t *)(sp + 8));
+      break;
+
+    case SYS_MUNLOCK:
+      if (!check_user_vaddr((int*)sp + 1)) exit(-1);
+      if (!check_user_vaddr((int*)sp + 2)) exit(-1);
+      f->eax = munlock((const void *)*(uint32_t *)(sp + 4), (size_t)*(uint32_t *)(sp + 8));
+      break;
   }
   // thread_exit ();
 }
@@ -173,16 +202,11 @@ remove (const char *file)
 int
 open (const char *file)
 {
-  lock_acquire (&file_lock);
-  if (file == NULL || !check_user_vaddr(file)) {
-    lock_release(&file_lock);
+  if (file == NULL || !check_user_vaddr(file))
     exit(-1);
-  }
   struct file *return_file = filesys_open (file);
-  if (return_file == NULL)  {
-    lock_release (&file_lock);
+  if (return_file == NULL)
     return -1;
-  }
   else
   {
     for (int i=3; i<128; i++)
@@ -193,12 +217,11 @@ open (const char *file)
           file_deny_write (return_file);
 
         thread_current()->fd_list[i] = return_file;
-        lock_release (&file_lock);
         return i;
       }
     }
   }
-  lock_release (&file_lock);
+  file_close (return_file);
   return -1;
 }
 
@@ -237,9 +260,7 @@ read (int fd, void *buffer, unsigned size)
       exit(-1);
     else
     {
-      lock_acquire (&file_lock);
-      bytes_read = file_read (f, buffer, size);
-      lock_release (&file_lock);
+      bytes_read = file_io (f, buffer, size, true);
       return bytes_read;
     }
   }
@@ -252,9 +273,7 @@ write (int fd, const void *buffer, unsigned size)
   check_user_vaddr (buffer);
   if (fd == 1) //STDOUT
   {
-    lock_acquire (&file_lock);
     putbuf (buffer, size);
-    lock_release (&file_lock);
     return size;
   }
   else
@@ -269,9 +288,7 @@ write (int fd, const void *buffer, unsigned size)
     {
       file_deny_write (f);
     }
-    lock_acquire (&file_lock);
-    bytes_written = file_write (f, buffer, size);
-    lock_release (&file_lock);
+    bytes_written = file_io (f, (void *) buffer, size, false);
 
     return bytes_written;
   }
@@ -305,7 +322,7 @@ close (int fd)
     exit(-1);
   else
   {
-    f = NULL;
+    thread_current()->fd_list[fd] = NULL;
     file_close (f);
   }
 }
@@ -321,24 +338,14 @@ mmap(int fd, void *addr)
 
   if (f == NULL)  return -1;
 
-  lock_acquire (&file_lock);
-
   opened_f = file_reopen(f);
   if (opened_f == NULL)
-  {
-    lock_release(&file_lock);
     return -1;
-  }
 
   mmf = init_mmf(thread_current()->map_cnt, opened_f, addr);
   thread_current()->map_cnt++;
   if (mmf == NULL)
-  {
-    lock_release(&file_lock);
     return -1;
-  }
-
-  lock_release(&file_lock);
 
   return mmf->id;
 }
@@ -360,25 +367,81 @@ munmap(int mapid)
   }
   if (e == list_end(&t->mmf_lst))  return;
 
-  lock_acquire(&file_lock);
-  
+  struct vma *vma;
   off_t max_length = file_length(mmf->file);
   off_t ofs = 0;
   while(ofs < max_length) {
     struct spt_entry *temp_entry = get_spt_entry(&t->sp_table, mmf->upage + ofs);
 
-    if(pagedir_is_dirty(t->pagedir, mmf->upage + ofs))  {
-      void* kpage = pagedir_get_page(t->pagedir, mmf->upage + ofs);
-      file_write_at(temp_entry->file, kpage, temp_entry->read_bytes, temp_entry->ofs);
+    /* Pages never brought in have nothing to write back. */
+    if(temp_entry == NULL) {
+      ofs += PGSIZE;
+      continue;
     }
 
+    falloc_write_back(temp_entry);
     delete_a_page(&t->sp_table, temp_entry);
 
     ofs += PGSIZE;
   }
+  /* madvise() may have split the mapping into several VMAs. */
+  void *end = pg_round_up(mmf->upage + max_length);
+  void *upage = mmf->upage;
+  while (upage < end && (vma = vma_find(upage)) != NULL) {
+    upage = vma->end;
+    if (vma->mmap && vma->file == mmf->file)  vma_remove(vma);
+  }
   list_remove(e);
+}
+
+int
+madvise(void *addr, size_t length, int advice)
+{
+  return advise_pages(addr, length, advice) ? 0 : -1;
+}
+
+int
+mlock(const void *addr, size_t length)
+{
+  return lock_pages((void *) addr, length) ? 0 : -1;
+}
+
+int
+munlock(const void *addr, size_t length)
+{
+  return unlock_pages((void *) addr, length) ? 0 : -1;
+}
+
+/* Reads SIZE bytes from F into user BUFFER, if READ, or writes
+   them from BUFFER to F, a chunk at a time.  Each chunk of BUFFER
+   is brought in and pinned first, so that the file system never
+   faults on it with its locks held.  Returns the number of bytes
+   transferred. */
+static int
+file_io (struct file *f, void *buffer, unsigned size, bool read)
+{
+  unsigned done = 0;
+
+  while (done < size)
+  {
+    unsigned chunk = size - done < PIN_CHUNK ? size - done : PIN_CHUNK;
+    int n;
+
+    if (!pin_user_buffer (buffer + done, chunk, read))
+      exit (-1);
+    if (read)
+      n = file_read (f, buffer + done, chunk);
+    else
+      n = file_write (f, buffer + done, chunk);
+    unpin_user_buffer (buffer + done, chunk);
 
-  lock_release(&file_lock);
+    if (n <= 0)
+      break;
+    done += n;
+    if ((unsigned) n < chunk)
+      break;
+  }
+  return done;
 }
 
 struct file
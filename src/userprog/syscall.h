@@ -1,8 +1,6 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
-#define PHYS_BASE 0xc0000000
-
 #include "lib/user/syscall.h"
 
 struct file 
@@ -1,40 +1,192 @@
 #include "vm/frame.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "vm/page.h"
+#include "vm/policy.h"
 #include "vm/swap.h"
 
 static struct lock ft_lock;
-static struct list ft_lst;
-static struct ft_entry *clock_pointer;
+static struct ft_entry *frames;     /* One entry per user pool page. */
+static size_t frame_cnt;
+static size_t free_cnt;             /* Frames with no owner. */
+static size_t locked_cnt;           /* Pages held by mlock(). */
+static size_t lock_max;             /* Limit on locked_cnt. */
 
+/* A frame mapped by more than one process.  Either a read-only
+   executable page, shared by every process that maps the same
+   page of the same executable, which lives in shared_frames,
+   keyed by (INODE, OFS), for as long as it is resident; or a
+   private page that fork() left shared copy-on-write, which has
+   a null INODE and is not in shared_frames.  Protected by
+   ft_lock, like the rest of the frame table. */
+struct shared_frame
+  {
+    struct hash_elem hash_elem;     /* Element in shared_frames. */
+    struct inode *inode;            /* Executable's inode. */
+    off_t ofs;                      /* Page's offset in INODE. */
+    void *kpage;                    /* Frame holding the page. */
+    struct list mappers;            /* List of struct mapper. */
+  };
+
+/* One process's mapping of a shared frame. */
+struct mapper
+  {
+    struct list_elem elem;          /* Element in shared_frame's list. */
+    struct thread *t;               /* Mapping process. */
+    struct spt_entry *spte;         /* Its page table entry. */
+  };
+
+static struct hash shared_frames;
+
+/* A page of zeros, mapped read-only wherever a process reads a
+   zero-filled page that it has not written yet.  Comes from the
+   kernel pool, so it is never in the frame table. */
+static void *zero_page;
+
+/* The pageout daemon wakes when fewer than low_wm frames are
+   free and evicts until high_wm are. */
+static size_t low_wm, high_wm;
+static struct condition pageout_cond;
+
+/* Signaled when a frame is freed or unpinned, for the pageout
+   daemon to wait on when every frame in use is pinned. */
+static struct condition unpin_cond;
+
+/* Statistics. */
+static unsigned pageout_wakeups;    /* Times the daemon woke up. */
+static unsigned pageout_cnt;        /* Pages evicted by the daemon. */
+static unsigned direct_cnt;         /* Pages evicted by faulting threads. */
+static unsigned swap_out_cnt;       /* Evicted pages written to swap. */
+static unsigned cluster_cnt;        /* Swap writes of more than one page. */
+static unsigned cluster_page_cnt;   /* Neighbours evicted with a victim. */
+static unsigned file_out_cnt;       /* Evicted pages written to files. */
+static unsigned drop_cnt;           /* Evicted pages just dropped. */
+static unsigned share_hit_cnt;      /* Faults that found a shared frame. */
+static unsigned share_miss_cnt;     /* Faults that read one in. */
+static unsigned cow_share_cnt;      /* Pages shared by fork(). */
+static unsigned cow_copy_cnt;       /* Copy-on-write faults that copied. */
+
+static bool evict(void);
+static thread_func pageout_daemon NO_RETURN;
+
+/* Returns frame F to the user pool, without touching any
+   mapping of it.  Must be called with ft_lock held. */
+static void
+free_frame(struct ft_entry *f)
+{
+  replace_policy->remove(f);
+  palloc_free_page(f->kpage);
+  f->t = NULL;
+  f->share = NULL;
+  free_cnt++;
+  cond_signal(&unpin_cond, &ft_lock);
+}
+
+static unsigned
+shared_frame_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct shared_frame *sf = hash_entry(e, struct shared_frame, hash_elem);
+  return hash_bytes(&sf->inode, sizeof sf->inode) ^ hash_int(sf->ofs);
+}
+
+static bool
+shared_frame_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct shared_frame *a = hash_entry(a_, struct shared_frame, hash_elem);
+  const struct shared_frame *b = hash_entry(b_, struct shared_frame, hash_elem);
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Sets up the frame table and starts the pageout daemon.  LOW
+   and HIGH are the daemon's free frame watermarks, in pages; 0
+   selects a default. */
 void
-FrameTable_init()
+FrameTable_init(size_t low, size_t high)
 {
+  size_t i;
+
   lock_init(&ft_lock);
-  list_init(&ft_lst);
-  clock_pointer = NULL;
+  cond_init(&pageout_cond);
+  cond_init(&unpin_cond);
+  frame_cnt = palloc_user_page_cnt();
+  free_cnt = frame_cnt;
+  frames = malloc(frame_cnt * sizeof *frames);
+  if (frames == NULL)
+    PANIC("FrameTable_init: out of memory");
+  for (i = 0; i < frame_cnt; i++) {
+    frames[i].kpage = NULL;
+    frames[i].upage = NULL;
+    frames[i].t = NULL;
+    frames[i].spte = NULL;
+    frames[i].pinned = false;
+    frames[i].evicting = false;
+    frames[i].lock_cnt = 0;
+    frames[i].share = NULL;
+    frames[i].last_use = 0;
+    frames[i].queue = 0;
+  }
+  replace_policy->init(frames, frame_cnt);
+  hash_init(&shared_frames, shared_frame_hash, shared_frame_less, NULL);
+  zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+
+  low_wm = low != 0 ? low : frame_cnt / 64 + 1;
+  high_wm = high != 0 ? high : 2 * low_wm;
+
+  /* Leave enough frames unlocked for everyone else to run. */
+  lock_max = frame_cnt / 2;
+  if (high_wm < low_wm)
+    high_wm = low_wm;
+  if (high_wm > frame_cnt)
+    high_wm = frame_cnt;
+  thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
 }
 
+/* Allocates a frame for user page UPAGE of the running thread.
+   The frame starts out pinned, so that it is not evicted while
+   the caller fills it in; the caller unpins it with
+   falloc_unpin_page() once it is mapped. */
 void *
 falloc_get_page(void *upage, enum palloc_flags flags)
 {
+  ASSERT(flags & PAL_USER);
+
   lock_acquire(&ft_lock);
 
   void *kpage;
   kpage = palloc_get_page(flags);
-  if (kpage == NULL)
+  while (kpage == NULL)
   {
-    evict();
-    kpage = palloc_get_page(flags);
-    if (kpage == NULL)
+    /* The daemon fell behind: evict a frame ourselves.  evict()
+       drops ft_lock while it writes the victim out, so another
+       thread may take the frame it frees before we do. */
+    if (!evict()) {
+      lock_release(&ft_lock);
       return NULL;
+    }
+    direct_cnt++;
+    kpage = palloc_get_page(flags);
   }
-  
-  struct ft_entry *temp_entry;
-  temp_entry =(struct ft_entry *)malloc(sizeof *temp_entry);
+
+  struct ft_entry *temp_entry = &frames[palloc_user_page_idx(kpage)];
   temp_entry->kpage = kpage;
   temp_entry->upage = upage;
   temp_entry->t = thread_current ();
-  list_push_back(&ft_lst, &temp_entry->list_elem);
+  temp_entry->spte = NULL;
+  temp_entry->pinned = true;
+  temp_entry->evicting = false;
+  temp_entry->lock_cnt = 0;
+  temp_entry->share = NULL;
+  replace_policy->add(temp_entry);
+
+  if (--free_cnt < low_wm)
+    cond_signal(&pageout_cond, &ft_lock);
 
   lock_release(&ft_lock);
 
@@ -55,44 +207,930 @@ falloc_free_page(void *kpage)
   if(temp_entry == NULL)
     exit (-1);
 
-  palloc_free_page(temp_entry->kpage);
-  pagedir_clear_page(temp_entry->t->pagedir, temp_entry->upage);
-  list_remove(&temp_entry->list_elem);
-  free(temp_entry);
+  if (temp_entry->t->pagedir != NULL)
+    pagedir_clear_page(temp_entry->t->pagedir, temp_entry->upage);
+  free_frame(temp_entry);
 
   if(flag)  lock_release(&ft_lock);
 }
 
+/* Returns the shared zero page. */
+void *
+falloc_zero_page(void)
+{
+  return zero_page;
+}
+
+/* Returns true if more frames are free than the pageout daemon
+   aims for, so that frames can be spent on pages nobody asked
+   for yet without causing evictions. */
+bool
+falloc_has_spare(void)
+{
+  bool spare;
+
+  lock_acquire(&ft_lock);
+  spare = free_cnt > high_wm;
+  lock_release(&ft_lock);
+  return spare;
+}
+
+/* Makes frame KPAGE, now mapped as the running process's page
+   E, eligible for eviction. */
+void
+falloc_unpin_page(void *kpage, struct spt_entry *e)
+{
+  struct ft_entry *f = &frames[palloc_user_page_idx(kpage)];
+
+  lock_acquire(&ft_lock);
+  f->spte = e;
+  f->pinned = false;
+  cond_signal(&unpin_cond, &ft_lock);
+  lock_release(&ft_lock);
+}
+
+/* Unpins frame F after a write-out that left it resident, unless
+   it is still held.  Must be called with ft_lock held. */
+static void
+end_pin(struct ft_entry *f)
+{
+  f->pinned = f->lock_cnt > 0;
+  if (!f->pinned)
+    cond_signal(&unpin_cond, &ft_lock);
+}
+
+/* Keeps frame F resident until a matching frame_unhold(), for
+   mlock() or a system call.  Must be called with ft_lock held. */
+static void
+frame_hold(struct ft_entry *f)
+{
+  f->lock_cnt++;
+  f->pinned = true;
+}
+
+/* Drops a hold on frame F taken by frame_hold().  Must be called
+   with ft_lock held. */
+static void
+frame_unhold(struct ft_entry *f)
+{
+  ASSERT(f->lock_cnt > 0);
+  if (--f->lock_cnt == 0 && !f->evicting) {
+    f->pinned = false;
+    cond_signal(&unpin_cond, &ft_lock);
+  }
+}
+
+/* Brings the running process's page E into a frame, unless it
+   is resident already, and returns with ft_lock held, so that it
+   stays resident until the caller pins it.  The frame may be a
+   share of one, but never the zero page.  If WRITE, also breaks
+   copy-on-write sharing.  Returns false, without the lock, if
+   memory runs out. */
+static bool
+fault_in(struct spt_entry *e, bool write)
+{
+  struct thread *cur = thread_current();
+
+  lock_acquire(&ft_lock);
+  while (e->state != IN_FRAME || (write && e->cow)) {
+    /* The page may be evicted again before we get the lock back,
+       so check again afterward. */
+    lock_release(&ft_lock);
+    if (e->state == IN_FRAME) {
+      if (!falloc_cow_break(e))
+        return false;
+    }
+    else {
+      if (e->state == IN_ZERO) {
+        pagedir_clear_page(cur->pagedir, e->upage);
+        e->state = ONLY_ZERO;
+      }
+      load_a_page(&cur->sp_table, e->upage, true);
+    }
+    lock_acquire(&ft_lock);
+  }
+  return true;
+}
+
+/* Locks the running process's page E into memory for mlock(),
+   bringing it in first if it is not resident, so that later
+   accesses cannot fault.  Returns false if too many pages are
+   locked already. */
+bool
+falloc_lock_page(struct spt_entry *e)
+{
+  struct ft_entry *f;
+
+  if (!fault_in(e, false))
+    return false;
+  if (!e->locked) {
+    if (locked_cnt >= lock_max) {
+      lock_release(&ft_lock);
+      return false;
+    }
+    f = &frames[palloc_user_page_idx(e->kpage)];
+    frame_hold(f);
+    e->locked = true;
+    locked_cnt++;
+  }
+  lock_release(&ft_lock);
+  return true;
+}
+
+/* Undoes falloc_lock_page() on E, if E is locked.  Must be
+   called with ft_lock held. */
+static void
+unlock_frame(struct spt_entry *e)
+{
+  struct ft_entry *f;
+
+  if (!e->locked)
+    return;
+  ASSERT(e->state == IN_FRAME);
+  f = &frames[palloc_user_page_idx(e->kpage)];
+  frame_unhold(f);
+  e->locked = false;
+  locked_cnt--;
+}
+
+/* Lets the running process's page E be evicted again after
+   falloc_lock_page(). */
+void
+falloc_unlock_page(struct spt_entry *e)
+{
+  lock_acquire(&ft_lock);
+  unlock_frame(e);
+  lock_release(&ft_lock);
+}
+
+/* Brings in the running process's page E, if need be, and pins
+   its frame for the duration of a system call that accesses it,
+   using the same count as mlock().  If WRITE, E gets a private
+   frame that the kernel can write.  Returns false if memory runs
+   out. */
+bool
+falloc_pin_user_page(struct spt_entry *e, bool write)
+{
+  struct ft_entry *f;
+
+  if (!fault_in(e, write))
+    return false;
+  f = &frames[palloc_user_page_idx(e->kpage)];
+  frame_hold(f);
+  lock_release(&ft_lock);
+  return true;
+}
+
+/* Undoes falloc_pin_user_page() on E. */
+void
+falloc_unpin_user_page(struct spt_entry *e)
+{
+  struct ft_entry *f;
+
+  lock_acquire(&ft_lock);
+  ASSERT(e->state == IN_FRAME);
+  f = &frames[palloc_user_page_idx(e->kpage)];
+  frame_unhold(f);
+  lock_release(&ft_lock);
+}
+
+/* Returns the entry for KPAGE, or NULL if KPAGE is not an
+   allocated user frame. */
 struct ft_entry*
 get_frame_table_entry(void* kpage)
 {
+  struct ft_entry *e = &frames[palloc_user_page_idx(kpage)];
+  return e->t != NULL ? e : NULL;
+}
+
+/* Returns true if frame F was accessed since the last call, by
+   any process that maps it, and clears its accessed bits.  Must
+   be called with ft_lock held. */
+bool
+frame_test_and_clear_accessed(struct ft_entry *f)
+{
+  bool accessed = false;
+
+  if (f->share == NULL) {
+    accessed = pagedir_is_accessed(f->t->pagedir, f->upage);
+    if (accessed)
+      pagedir_set_accessed(f->t->pagedir, f->upage, false);
+  }
+  else {
+    struct list_elem *e;
+    for (e = list_begin(&f->share->mappers); e != list_end(&f->share->mappers);
+         e = list_next(e)) {
+      struct mapper *m = list_entry(e, struct mapper, elem);
+      if (pagedir_is_accessed(m->t->pagedir, m->spte->upage)) {
+        pagedir_set_accessed(m->t->pagedir, m->spte->upage, false);
+        accessed = true;
+      }
+    }
+  }
+  return accessed;
+}
+
+/* Frees shared frame F, which must have no mappers left.
+   Must be called with ft_lock held. */
+static void
+free_shared(struct ft_entry *f)
+{
+  ASSERT(list_empty(&f->share->mappers));
+
+  if (f->share->inode != NULL)
+    hash_delete(&shared_frames, &f->share->hash_elem);
+  free(f->share);
+  free_frame(f);
+}
+
+/* Makes copy-on-write frame F, which has a single mapper left,
+   private to that mapper again.  The mapping stays read-only
+   until the mapper writes to it; it is marked dirty, since its
+   contents may exist nowhere else.  Must be called with ft_lock
+   held. */
+static void
+unshare(struct ft_entry *f)
+{
+  struct mapper *m = list_entry(list_pop_front(&f->share->mappers),
+                                struct mapper, elem);
+
+  ASSERT(f->share->inode == NULL && list_empty(&f->share->mappers));
+
+  f->t = m->t;
+  f->upage = m->spte->upage;
+  f->spte = m->spte;
+  pagedir_set_dirty(m->t->pagedir, m->spte->upage, true);
+  free(f->share);
+  f->share = NULL;
+  free(m);
+}
+
+/* Evicts shared frame F by unmapping it from every process that
+   maps it.  An executable page is simply dropped.  A
+   copy-on-write page is written to swap once, and every mapper
+   gets a reference to the slot; each reads back a private copy.
+   The write is made without ft_lock, while the mappers can still
+   read the page; if meanwhile the frame stopped being shared or
+   was locked, it stays resident.  Must be called with ft_lock
+   held. */
+static void
+evict_shared(struct ft_entry *f)
+{
+  bool cow = f->share->inode == NULL;
+  bool first = true;
+  int swap_id = -1;
   struct list_elem *e;
-  for (e = list_begin(&ft_lst); e != list_end(&ft_lst); e = list_next(e))
-    if (list_entry(e, struct ft_entry, list_elem)->kpage == kpage)
-      return list_entry(e, struct ft_entry, list_elem);
-  return NULL;
+
+  if (cow) {
+    f->evicting = true;
+    f->pinned = true;
+    lock_release(&ft_lock);
+    swap_id = swap_evict(f->kpage);
+    lock_acquire(&ft_lock);
+    f->evicting = false;
+
+    if (f->share == NULL || f->lock_cnt > 0) {
+      swap_free(swap_id);
+      end_pin(f);
+      return;
+    }
+    swap_out_cnt++;
+  }
+  else
+    drop_cnt++;
+
+  for (e = list_begin(&f->share->mappers); e != list_end(&f->share->mappers);
+       e = list_next(e)) {
+    struct mapper *m = list_entry(e, struct mapper, elem);
+    pagedir_clear_page(m->t->pagedir, m->spte->upage);
+  }
+
+  while (!list_empty(&f->share->mappers)) {
+    struct mapper *m = list_entry(list_pop_front(&f->share->mappers),
+                                  struct mapper, elem);
+    if (cow) {
+      if (!first)
+        swap_dup(swap_id);
+      first = false;
+      m->spte->state = IN_SWAP;
+      m->spte->swap_id = swap_id;
+      m->spte->cow = false;
+    }
+    else
+      m->spte->state = IN_FILE;
+    m->spte->kpage = NULL;
+    free(m);
+  }
+  if (first && swap_id >= 0)
+    swap_free(swap_id);
+  free_shared(f);
+}
+
+/* Looks up the resident shared frame for page OFS of INODE.
+   Must be called with ft_lock held. */
+static struct shared_frame *
+lookup_shared(struct inode *inode, off_t ofs)
+{
+  struct shared_frame key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  e = hash_find(&shared_frames, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct shared_frame, hash_elem) : NULL;
+}
+
+/* Maps read-only executable page E, which must be IN_FILE, into
+   the running process.  If another process already has the page
+   in memory, maps the same frame; otherwise reads it in and
+   makes it available to others.  Returns false on failure. */
+bool
+falloc_map_shared(struct spt_entry *e)
+{
+  struct thread *cur = thread_current();
+  struct inode *inode = file_get_inode(e->file);
+  struct shared_frame *sf;
+  struct mapper *m;
+
+  ASSERT(e->shared && e->state == IN_FILE);
+
+  m = malloc(sizeof *m);
+  if (m == NULL)
+    return false;
+  m->t = cur;
+  m->spte = e;
+
+  lock_acquire(&ft_lock);
+  sf = lookup_shared(inode, e->ofs);
+  if (sf != NULL)
+    share_hit_cnt++;
+  else {
+    /* Read the page in without holding ft_lock.  The new frame
+       is pinned until it is published, so it stays put. */
+    lock_release(&ft_lock);
+    void *kpage = falloc_get_page(e->upage, PAL_USER);
+    if (kpage == NULL) {
+      free(m);
+      return false;
+    }
+    if (file_read_at(e->file, kpage, e->read_bytes, e->ofs)
+        != (off_t) e->read_bytes) {
+      falloc_free_page(kpage);
+      free(m);
+      return false;
+    }
+    memset(kpage + e->read_bytes, 0, e->padding);
+
+    lock_acquire(&ft_lock);
+    sf = lookup_shared(inode, e->ofs);
+    if (sf != NULL) {
+      /* Another process read the same page in meanwhile. */
+      free_frame(&frames[palloc_user_page_idx(kpage)]);
+      share_hit_cnt++;
+    }
+    else {
+      struct ft_entry *f = &frames[palloc_user_page_idx(kpage)];
+      sf = malloc(sizeof *sf);
+      if (sf == NULL) {
+        falloc_free_page(kpage);
+        lock_release(&ft_lock);
+        free(m);
+        return false;
+      }
+      sf->inode = inode;
+      sf->ofs = e->ofs;
+      sf->kpage = kpage;
+      list_init(&sf->mappers);
+      hash_insert(&shared_frames, &sf->hash_elem);
+      f->share = sf;
+      f->pinned = false;
+      share_miss_cnt++;
+    }
+  }
+
+  if (!pagedir_set_page(cur->pagedir, e->upage, sf->kpage, false)) {
+    if (list_empty(&sf->mappers))
+      free_shared(&frames[palloc_user_page_idx(sf->kpage)]);
+    lock_release(&ft_lock);
+    free(m);
+    return false;
+  }
+  list_push_back(&sf->mappers, &m->elem);
+  e->kpage = sf->kpage;
+  e->state = IN_FRAME;
+  lock_release(&ft_lock);
+  return true;
+}
+
+/* Unmaps shared page E from the running process, freeing its
+   frame if no other process maps it.  Must be called with
+   ft_lock held. */
+static void
+unmap_shared(struct spt_entry *e)
+{
+  struct thread *cur = thread_current();
+  struct ft_entry *f = &frames[palloc_user_page_idx(e->kpage)];
+  struct list_elem *el;
+
+  for (el = list_begin(&f->share->mappers); el != list_end(&f->share->mappers);
+       el = list_next(el)) {
+    struct mapper *m = list_entry(el, struct mapper, elem);
+    if (m->spte == e) {
+      list_remove(el);
+      free(m);
+      break;
+    }
+  }
+  if (cur->pagedir != NULL)
+    pagedir_clear_page(cur->pagedir, e->upage);
+  if (list_empty(&f->share->mappers)) {
+    /* evict_shared() frees the frame once its write is done. */
+    if (!f->evicting)
+      free_shared(f);
+  }
+  else if (f->share->inode == NULL && list_size(&f->share->mappers) == 1)
+    unshare(f);
+}
+
+/* Releases the frame holding the running process's page E, if
+   the page is resident, as E is about to be destroyed.  The
+   check is made under ft_lock, so a concurrent eviction of the
+   page is harmless.  If the page is being written out, the
+   frame is left to evict(), which frees it when the write is
+   done. */
+void
+falloc_release_page(struct spt_entry *e)
+{
+  lock_acquire(&ft_lock);
+  unlock_frame(e);
+  if (e->state == IN_FRAME) {
+    struct ft_entry *f = &frames[palloc_user_page_idx(e->kpage)];
+    if (f->share != NULL)
+      unmap_shared(e);
+    else if (f->evicting) {
+      if (f->t->pagedir != NULL)
+        pagedir_clear_page(f->t->pagedir, f->upage);
+      f->spte = NULL;
+    }
+    else
+      falloc_free_page(e->kpage);
+    e->kpage = NULL;
+  }
+  lock_release(&ft_lock);
+}
+
+/* Maps PARENT's resident page P into the running process, as
+   its page C, sharing P's frame.  A private page becomes
+   copy-on-write in both processes.  Must be called with ft_lock
+   held. */
+static bool
+fork_frame(struct thread *parent, struct spt_entry *p, struct spt_entry *c)
+{
+  struct thread *cur = thread_current();
+  struct ft_entry *f = &frames[palloc_user_page_idx(p->kpage)];
+  struct mapper *m, *pm = NULL;
+
+  m = malloc(sizeof *m);
+  if (m == NULL)
+    return false;
+  if (f->share == NULL) {
+    pm = malloc(sizeof *pm);
+    f->share = malloc(sizeof *f->share);
+    if (pm == NULL || f->share == NULL) {
+      free(f->share);
+      f->share = NULL;
+      free(pm);
+      free(m);
+      return false;
+    }
+    f->share->inode = NULL;
+    f->share->ofs = 0;
+    f->share->kpage = f->kpage;
+    list_init(&f->share->mappers);
+    pm->t = parent;
+    pm->spte = p;
+    list_push_back(&f->share->mappers, &pm->elem);
+    pagedir_set_writable(parent->pagedir, p->upage, false);
+    p->cow = true;
+    cow_share_cnt++;
+  }
+
+  if (!pagedir_set_page(cur->pagedir, c->upage, f->kpage, false)) {
+    free(m);
+    return false;
+  }
+  m->t = cur;
+  m->spte = c;
+  list_push_back(&f->share->mappers, &m->elem);
+  c->state = IN_FRAME;
+  c->kpage = f->kpage;
+  c->cow = f->share->inode == NULL;
+  return true;
 }
 
-void evict() {
+/* Writes T's memory-mapped page E back to its file if it is
+   resident and dirty.  The write is made without ft_lock, holding
+   the frame so that it stays put.  Must be called with ft_lock
+   held. */
+static void
+write_back(struct thread *t, struct spt_entry *e)
+{
+  struct ft_entry *f;
 
-  struct ft_entry *temp_entry = clock_pointer;
-  do {
-    if(clock_pointer == NULL) temp_entry = list_entry(list_begin(&ft_lst), struct ft_entry, list_elem);
-    else  {
-      pagedir_set_accessed(temp_entry->t->pagedir, temp_entry->upage, false);
+  if (e->state != IN_FRAME || !pagedir_is_dirty(t->pagedir, e->upage))
+    return;
+  f = &frames[palloc_user_page_idx(e->kpage)];
+  frame_hold(f);
+  pagedir_set_dirty(t->pagedir, e->upage, false);
+  lock_release(&ft_lock);
+  file_write_at(e->file, e->kpage, e->read_bytes, e->ofs);
+  lock_acquire(&ft_lock);
+  frame_unhold(f);
+}
+
+/* Writes the running process's memory-mapped page E back to its
+   file if it is resident and dirty, for munmap() and
+   madvise(). */
+void
+falloc_write_back(struct spt_entry *e)
+{
+  lock_acquire(&ft_lock);
+  write_back(thread_current(), e);
+  lock_release(&ft_lock);
+}
 
-      if (list_next(&clock_pointer->list_elem) == list_end(&ft_lst)) {
-        temp_entry = list_entry(list_begin(&ft_lst), struct ft_entry, list_elem);
-      } else {
-        temp_entry = list_next(temp_entry);
+/* Sets up C, a copy of PARENT's supplemental page table entry P,
+   as the running process's page, for fork().  A resident page is
+   shared with the parent: copy-on-write if private, and for
+   reading only if it is an executable page.  A swapped-out page
+   shares the parent's swap slot.  Memory-mapped pages are
+   written back, then read from the file by each process, so
+   parent and child only see each other's later writes after
+   munmap().  Returns false if memory runs out. */
+bool
+falloc_fork_page(struct thread *parent, struct spt_entry *p,
+                 struct spt_entry *c)
+{
+  bool success = true;
+
+  lock_acquire(&ft_lock);
+  c->state = p->state;
+  c->kpage = NULL;
+  c->cow = false;
+  switch (p->state) {
+  case IN_SWAP:
+    swap_dup(p->swap_id);
+    break;
+  case IN_ZERO:
+    c->state = ONLY_ZERO;
+    break;
+  case IN_FRAME:
+    if (p->mmap) {
+      write_back(parent, p);
+      c->state = IN_FILE;
+    }
+    else {
+      c->state = ONLY_ZERO;
+      success = fork_frame(parent, p, c);
+    }
+    break;
+  }
+  lock_release(&ft_lock);
+  return success;
+}
+
+/* Handles a write by the running process to its copy-on-write
+   page E.  If other processes still share E's frame, gives E a
+   private copy; otherwise just makes the existing frame writable
+   again.  Returns false if memory runs out. */
+bool
+falloc_cow_break(struct spt_entry *e)
+{
+  struct thread *cur = thread_current();
+  void *copy = NULL;
+
+  lock_acquire(&ft_lock);
+  while (e->state == IN_FRAME && e->cow) {
+    struct ft_entry *f = &frames[palloc_user_page_idx(e->kpage)];
+    struct list_elem *el;
+
+    if (f->share == NULL) {
+      pagedir_set_writable(cur->pagedir, e->upage, true);
+      e->cow = false;
+      break;
+    }
+
+    if (copy == NULL) {
+      /* Allocating may evict, even E's frame, so check again
+         afterward. */
+      lock_release(&ft_lock);
+      copy = falloc_get_page(e->upage, PAL_USER);
+      if (copy == NULL)
+        return false;
+      lock_acquire(&ft_lock);
+      continue;
+    }
+
+    memcpy(copy, e->kpage, PGSIZE);
+    for (el = list_begin(&f->share->mappers);
+         el != list_end(&f->share->mappers); el = list_next(el)) {
+      struct mapper *m = list_entry(el, struct mapper, elem);
+      if (m->spte == e) {
+        list_remove(el);
+        free(m);
+        break;
       }
     }
-  } while(!pagedir_is_accessed(temp_entry->t->pagedir, temp_entry->upage));
+    if (list_size(&f->share->mappers) == 1)
+      unshare(f);
+
+    pagedir_clear_page(cur->pagedir, e->upage);
+    if (!pagedir_set_page(cur->pagedir, e->upage, copy, true)) {
+      free_frame(&frames[palloc_user_page_idx(copy)]);
+      unlock_frame(e);
+      e->state = ONLY_ZERO;
+      e->kpage = NULL;
+      lock_release(&ft_lock);
+      return false;
+    }
+    pagedir_set_dirty(cur->pagedir, e->upage, true);
 
-  struct spt_entry *s;
-  s = get_spt_entry(&thread_current()->sp_table, temp_entry->upage);
-  s->state = IN_SWAP;
-  s->swap_id = swap_evict(temp_entry->kpage);
+    /* A locked page keeps its lock on its new frame. */
+    if (e->locked) {
+      frame_unhold(f);
+      frames[palloc_user_page_idx(copy)].lock_cnt = 1;
+    }
+    frames[palloc_user_page_idx(copy)].spte = e;
+    frames[palloc_user_page_idx(copy)].pinned = e->locked;
+    e->kpage = copy;
+    e->cow = false;
+    copy = NULL;
+    cow_copy_cnt++;
+  }
+  if (copy != NULL)
+    free_frame(&frames[palloc_user_page_idx(copy)]);
+  lock_release(&ft_lock);
+  return true;
+}
+
+/* Unmaps private frame F's page if it is still clean and nothing
+   holds F.  The check and the unmapping are made with interrupts
+   off, so that the owner cannot dirty the page in between.
+   Must be called with ft_lock held. */
+static bool
+unmap_if_clean(struct ft_entry *f)
+{
+  enum intr_level old_level;
+  bool clean;
+
+  if (f->lock_cnt > 0 || f->share != NULL)
+    return false;
+  old_level = intr_disable();
+  clean = !pagedir_is_dirty(f->t->pagedir, f->upage);
+  if (clean)
+    pagedir_clear_page(f->t->pagedir, f->upage);
+  intr_set_level(old_level);
+  return clean;
+}
+
+/* Prepares private frame F for being written out without
+   ft_lock.  F stays mapped, but pinned, and its page is marked
+   clean, so that end_write_out() can tell whether its owner
+   wrote to it meanwhile.  Must be called with ft_lock held. */
+static void
+begin_write_out(struct ft_entry *f)
+{
+  f->evicting = true;
+  f->pinned = true;
+  pagedir_set_dirty(f->t->pagedir, f->upage, false);
+}
+
+/* Finishes writing out private frame F, with ft_lock held again.
+   Returns true if F can be freed: its page was released
+   meanwhile, or is still clean and is now unmapped.  Otherwise,
+   if its page was written to, locked or shared by fork(), F
+   stays resident and the copy just written is stale. */
+static bool
+end_write_out(struct ft_entry *f)
+{
+  f->evicting = false;
+  if (f->share != NULL) {
+    /* fork() shared F meanwhile; its mappers may all be gone. */
+    if (list_empty(&f->share->mappers))
+      free_shared(f);
+    else
+      end_pin(f);
+    return false;
+  }
+  if (f->spte == NULL || unmap_if_clean(f))
+    return true;
+  pagedir_set_dirty(f->t->pagedir, f->upage, true);
+  end_pin(f);
+  return false;
+}
+
+/* Writes dirty memory-mapped frame F back to its file and frees
+   it, unless its page is used again meanwhile.  Must be called
+   with ft_lock held, which is dropped during the write. */
+static void
+evict_to_file(struct ft_entry *f)
+{
+  struct spt_entry *s = f->spte;
+  struct file *file = s->file;
+  off_t ofs = s->ofs;
+  uint32_t read_bytes = s->read_bytes;
+
+  begin_write_out(f);
+  lock_release(&ft_lock);
+  file_write_at(file, f->kpage, read_bytes, ofs);
+  lock_acquire(&ft_lock);
+
+  file_out_cnt++;
+  s = f->spte;
+  if (end_write_out(f)) {
+    if (s != NULL) {
+      s->state = IN_FILE;
+      s->kpage = NULL;
+    }
+    free_frame(f);
+  }
+}
+
+/* Swaps out dirty private frame VICTIM, along with as many as
+   SWAP_CLUSTER - 1 of the pages that follow its page in its
+   owner's address space, as long as each is resident, private,
+   dirty, and not recently used.  The pages go to consecutive swap
+   slots in a single write, so that a later fault can read them
+   back together.  Must be called with ft_lock held, which is
+   dropped during the write. */
+static void
+swap_out_cluster(struct ft_entry *victim)
+{
+  struct thread *owner = victim->t;
+  struct ft_entry *fs[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  int ids[SWAP_CLUSTER];
+  size_t cnt = 1;
+  size_t out = 0;
+  size_t i;
+  int id;
+
+  fs[0] = victim;
+  kpages[0] = victim->kpage;
+  while (cnt < SWAP_CLUSTER) {
+    void *upage = victim->upage + cnt * PGSIZE;
+    struct ft_entry *f;
+    void *k;
+
+    /* Find the neighbour through OWNER's page directory and the
+       frame table; OWNER's page table is not ours to search. */
+    if (!is_user_vaddr(upage))  break;
+    if (!pagedir_is_dirty(owner->pagedir, upage)
+        || pagedir_is_accessed(owner->pagedir, upage))
+      break;
+    k = pagedir_get_page(owner->pagedir, upage);
+    if (k == NULL || k == zero_page)  break;
+    f = &frames[palloc_user_page_idx(k)];
+    if (f->t != owner || f->pinned || f->share != NULL || f->spte == NULL
+        || f->spte->mmap)
+      break;
+
+    fs[cnt] = f;
+    kpages[cnt++] = k;
+  }
 
-  falloc_free_page(temp_entry->kpage);
-}
\ No newline at end of file
+  for (i = 0; i < cnt; i++)
+    begin_write_out(fs[i]);
+  lock_release(&ft_lock);
+  id = swap_evict_run(kpages, cnt);
+  for (i = 0; i < cnt; i++)
+    ids[i] = id >= 0 ? id + (int) i : swap_evict(kpages[i]);
+  lock_acquire(&ft_lock);
+
+  for (i = 0; i < cnt; i++) {
+    struct spt_entry *s = fs[i]->spte;
+    if (!end_write_out(fs[i])) {
+      swap_free(ids[i]);
+      continue;
+    }
+    if (s != NULL) {
+      s->state = IN_SWAP;
+      s->swap_id = ids[i];
+      s->kpage = NULL;
+      s->cow = false;
+    }
+    else
+      swap_free(ids[i]);
+    free_frame(fs[i]);
+    out++;
+  }
+  swap_out_cnt += out;
+  if (cnt > 1) {
+    cluster_cnt++;
+    cluster_page_cnt += cnt - 1;
+  }
+}
+
+/* Returns true if evicting frame F would mean writing it out:
+   it is a private page modified since it was brought in, or a
+   copy-on-write page, which exists nowhere else.  Must be called
+   with ft_lock held. */
+bool
+frame_is_dirty(struct ft_entry *f)
+{
+  if (f->share != NULL)
+    return f->share->inode == NULL;
+  return pagedir_is_dirty(f->t->pagedir, f->upage);
+}
+
+/* Evicts one frame chosen by the replacement policy.  Returns
+   false if no frame can be evicted.  Must be called with ft_lock
+   held.  Writing the victim out is done without ft_lock, so that
+   threads faulting on other pages, possibly while holding file
+   system locks, are not held up; the victim may then turn out to
+   be in use again, and stay resident, but the call still counts
+   as progress. */
+static bool
+evict(void)
+{
+  struct ft_entry *temp_entry;
+
+  /* The TLB is flushed once at the end of the policy's scan
+     rather than once for every accessed bit it clears. */
+  pagedir_batch_begin();
+  temp_entry = replace_policy->choose();
+  pagedir_batch_end();
+  if (temp_entry == NULL)
+    return false;
+
+  if (temp_entry->share != NULL) {
+    evict_shared(temp_entry);
+    return true;
+  }
+
+  /* Only pages with no other up-to-date copy go to swap.  Memory
+     mapped pages are written back to their file, and clean pages
+     are simply dropped and later re-read from their file or
+     zero-filled again. */
+  struct spt_entry *s = temp_entry->spte;
+  if (unmap_if_clean(temp_entry)) {
+    s->state = s->file != NULL ? IN_FILE : ONLY_ZERO;
+    s->kpage = NULL;
+    s->cow = false;
+    free_frame(temp_entry);
+    drop_cnt++;
+  }
+  else if (s->mmap)
+    evict_to_file(temp_entry);
+  else
+    swap_out_cluster(temp_entry);
+  return true;
+}
+
+/* Keeps at least low_wm frames free, so that page faults rarely
+   have to wait for an eviction.  Whenever falloc_get_page()
+   leaves fewer than low_wm frames free, evicts frames until
+   high_wm are.  ft_lock is dropped between evictions, so faults
+   that find a free frame wait for at most one page-out. */
+static void
+pageout_daemon(void *aux UNUSED)
+{
+  lock_acquire(&ft_lock);
+  for (;;) {
+    while (free_cnt >= low_wm)
+      cond_wait(&pageout_cond, &ft_lock);
+
+    pageout_wakeups++;
+    while (free_cnt < high_wm) {
+      if (!evict()) {
+        /* Every frame in use is pinned, by a load or a write-out
+           in progress: wait for one to be released. */
+        cond_wait(&unpin_cond, &ft_lock);
+        continue;
+      }
+      pageout_cnt++;
+      lock_release(&ft_lock);
+      thread_yield();
+      lock_acquire(&ft_lock);
+    }
+  }
+}
+
+/* Prints frame table and pageout statistics. */
+void
+frame_print_stats(void)
+{
+  printf("Frames: %zu total, %zu free, %zu locked, watermarks %zu/%zu, "
+         "%s policy\n", frame_cnt, free_cnt, locked_cnt, low_wm, high_wm,
+         replace_policy->name);
+  printf("Pageout: %u wakeups, %u pages by daemon, %u direct; "
+         "%u to swap, %u to files, %u dropped\n",
+         pageout_wakeups, pageout_cnt, direct_cnt,
+         swap_out_cnt, file_out_cnt, drop_cnt);
+  printf("Swap clusters: %u writes, %u extra pages\n",
+         cluster_cnt, cluster_page_cnt);
+  printf("Shared text: %zu frames, %u hits, %u misses\n",
+         hash_size(&shared_frames), share_hit_cnt, share_miss_cnt);
+  printf("Copy-on-write: %u pages shared, %u copied\n",
+         cow_share_cnt, cow_copy_cnt);
+}
@@ -7,19 +7,56 @@
 #include "threads/thread.h"
 #include "threads/malloc.h"
 
+struct spt_entry;
+
+/* One entry per page of the user pool, indexed by
+   palloc_user_page_idx(kpage).  T is NULL while the frame is free.
+   A pinned frame is never chosen for eviction.  A frame stays
+   pinned while LOCK_CNT, the number of mlock()ed pages that map
+   it plus the number of system calls using it, is nonzero, and
+   while evict() writes it out without holding the frame table
+   lock.  A frame holding a
+   read-only executable page may be mapped by several processes;
+   SHARE then lists them, and T, UPAGE and SPTE are meaningless.
+   SPTE lets the pageout daemon reach the owner's entry for the
+   page without searching the owner's page table, which only the
+   owner may do. */
 struct ft_entry
   {
     void *kpage;
     void *upage;
 
     struct thread *t;
+    struct spt_entry *spte;     /* T's entry for UPAGE, once mapped. */
+    bool pinned;
+    bool evicting;              /* Being written out by evict()? */
+    int lock_cnt;
+    struct shared_frame *share;
 
-    struct list_elem list_elem;
+    /* Owned by the replacement policy (vm/policy.c). */
+    struct list_elem q_elem;
+    int64_t last_use;
+    int queue;
   };
 
-void FrameTable_init(void);
+void FrameTable_init(size_t low, size_t high);
 void *falloc_get_page(void*, enum palloc_flags);
 void  falloc_free_page(void*);
+void  falloc_unpin_page(void*, struct spt_entry *);
+bool  falloc_has_spare(void);
+bool  falloc_map_shared(struct spt_entry *);
+void  falloc_release_page(struct spt_entry *);
+void  falloc_write_back(struct spt_entry *);
+bool  falloc_fork_page(struct thread *, struct spt_entry *, struct spt_entry *);
+bool  falloc_cow_break(struct spt_entry *);
+bool  falloc_lock_page(struct spt_entry *);
+void  falloc_unlock_page(struct spt_entry *);
+bool  falloc_pin_user_page(struct spt_entry *, bool write);
+void  falloc_unpin_user_page(struct spt_entry *);
 struct ft_entry *get_frame_table_entry(void*);
+void *falloc_zero_page(void);
+bool frame_test_and_clear_accessed(struct ft_entry *);
+bool frame_is_dirty(struct ft_entry *);
+void frame_print_stats(void);
 
 #endif
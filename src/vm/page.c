@@ -1,10 +1,25 @@
 #include "vm/page.h"
 #include "threads/thread.h"
 #include "vm/frame.h"
+#include "vm/swap.h"
+#include <stdio.h>
 #include <string.h>
 #include "threads/vaddr.h"
+#include "userprog/exception.h"
+#include "userprog/syscall.h"
 
-extern struct lock file_lock;
+
+/* Pages to consider around each fault that reads a page in; see
+   fault_around().  Set with -fault-around. */
+size_t fault_around_pages = 16;
+
+static unsigned fault_around_cnt;   /* Pages mapped by fault_around(). */
+static unsigned willneed_cnt;       /* Pages read in by MADV_WILLNEED. */
+static unsigned dontneed_cnt;       /* Pages dropped by MADV_DONTNEED. */
+
+static bool map_frame(struct spt_entry *, void *, bool);
+static void fault_around(struct hash *, struct spt_entry *, int);
+static void drop_behind(struct hash *, void *, size_t);
 
 static unsigned
 hash_hash_func_spt(const struct hash_elem* elem, void* aux) {
@@ -20,6 +35,11 @@ hash_less_func_spt(const struct hash_elem* a, const struct hash_elem* b, void* a
 static void
 page_destructor(struct hash_elem* elem, void* aux) {
   struct spt_entry* e = hash_entry(elem, struct spt_entry, hash_elem);
+  falloc_release_page(e);
+  if (e->state == IN_SWAP)
+    swap_free(e->swap_id);
+  else if (e->state == IN_ZERO)
+    pagedir_clear_page(thread_current()->pagedir, e->upage);
   free(e);
 }
 
@@ -28,39 +48,169 @@ init_SupplementalPageTable(struct hash* spt) {
   hash_init(spt, hash_hash_func_spt, hash_less_func_spt, NULL);
 }
 
+static void
+vma_destructor(struct avl_elem *elem, void *aux UNUSED) {
+  free(avl_entry(elem, struct vma, avl_elem));
+}
+
+/* Destroys the running process's supplemental page table SPT
+   and its virtual memory areas. */
 void
 destroy_SupplementalPageTable(struct hash* spt) {
+  ASSERT(spt == &thread_current()->sp_table);
   hash_destroy(spt, page_destructor);
+  avl_destroy(&thread_current()->vm_areas, vma_destructor);
+}
+
+static bool
+vma_less(const struct avl_elem *a, const struct avl_elem *b, void *aux UNUSED) {
+  return avl_entry(a, struct vma, avl_elem)->start < avl_entry(b, struct vma, avl_elem)->start;
 }
 
 void
+vma_init(struct avl *vm_areas) {
+  avl_init(vm_areas, vma_less, NULL);
+}
+
+/* Adds a VMA of PAGE_CNT pages at START to the running process.
+   Its first READ_BYTES bytes come from FILE, starting at OFS,
+   and the rest are zeros; FILE may be null if READ_BYTES is 0.
+   The caller sets the mmap and shared flags.  Returns the new
+   VMA, or NULL if memory runs out or START is already taken. */
+struct vma *
+vma_add(void *start, size_t page_cnt, struct file *file, off_t ofs, uint32_t read_bytes, bool writable)
+{
+  struct vma *v = malloc(sizeof *v);
+  if (v == NULL)  return NULL;
+
+  ASSERT(pg_ofs(start) == 0 && page_cnt > 0);
+  v->start = start;
+  v->end = start + page_cnt * PGSIZE;
+  v->file = file;
+  v->ofs = ofs;
+  v->read_bytes = read_bytes;
+  v->writable = writable;
+  v->mmap = false;
+  v->shared = false;
+  v->advice = MADV_NORMAL;
+
+  if (avl_insert(&thread_current()->vm_areas, &v->avl_elem) != NULL) {
+    free(v);
+    return NULL;
+  }
+  return v;
+}
+
+/* Returns the last of the running process's VMAs that starts at
+   or below ADDR, or NULL if there is none. */
+static struct vma *
+vma_floor(const void *addr)
+{
+  struct vma key;
+  struct avl_elem *e;
+
+  key.start = (void *) addr;
+  e = avl_floor(&thread_current()->vm_areas, &key.avl_elem);
+  return e != NULL ? avl_entry(e, struct vma, avl_elem) : NULL;
+}
+
+/* Returns the running process's VMA that contains UPAGE, or
+   NULL if UPAGE is not mapped. */
+struct vma *
+vma_find(const void *upage)
+{
+  struct vma *v = vma_floor(upage);
+  return v != NULL && upage < v->end ? v : NULL;
+}
+
+/* Returns true if any of the running process's VMAs has a page
+   in [START, END). */
+bool
+vma_overlaps(const void *start, const void *end)
+{
+  struct vma *v;
+
+  if (end <= start)  return false;
+  v = vma_floor(end - 1);
+  return v != NULL && v->end > start;
+}
+
+/* Removes VMA V from the running process and frees it.  The
+   caller must already have removed any spt_entry in it. */
+void
+vma_remove(struct vma *v)
+{
+  avl_delete(&thread_current()->vm_areas, &v->avl_elem);
+  free(v);
+}
+
+/* Extends the running process's stack down to UPAGE.  Returns
+   false if memory runs out. */
+bool
+grow_stack(void *upage)
+{
+  struct vma *stack = vma_find(PHYS_BASE - PGSIZE);
+
+  /* Lowering the start of the topmost VMA keeps the tree in
+     order, as long as nothing is mapped in between. */
+  if (stack != NULL && stack->file == NULL && upage < stack->start
+      && !vma_overlaps(upage, stack->start)) {
+    stack->start = upage;
+    return true;
+  }
+  return vma_add(upage, 1, NULL, 0, 0, true) != NULL;
+}
+
+/* Returns true if UPAGE, in VMA V, starts out with data from
+   V's file rather than all zeros. */
+static bool
+vma_has_data(struct vma *v, void *upage)
+{
+  return v->file != NULL && (uint32_t) (upage - v->start) < v->read_bytes;
+}
+
+struct spt_entry*
 init_zero_spt_entry(struct hash* sp_hash_table, void* upage)
 {
   struct spt_entry* e;
   e = (struct spt_entry*) malloc(sizeof *e);
+  if (e == NULL)  return NULL;
   
   e->upage = upage;
   e->kpage = NULL;
   e->state = ONLY_ZERO;
   e->file = NULL;
   e->writable = true;
+  e->mmap = false;
+  e->shared = false;
+  e->cow = false;
+  e->locked = false;
   
   hash_insert(sp_hash_table, &e->hash_elem);
+
+  return e;
 }
 
-void
+struct spt_entry*
 init_frame_spt_entry(struct hash* sp_hash_table, void* upage, void* kpage)
 {
   struct spt_entry* e;
   e = (struct spt_entry*) malloc(sizeof *e);
+  if (e == NULL)  return NULL;
 
   e->upage = upage;
   e->kpage = kpage;
   e->state = IN_FRAME;
   e->file = NULL;
   e->writable = true;
+  e->mmap = false;
+  e->shared = false;
+  e->cow = false;
+  e->locked = false;
   
   hash_insert(sp_hash_table, &e->hash_elem);
+
+  return e;
 }
 
 struct spt_entry*
@@ -69,6 +219,7 @@ init_file_spt_entry(struct hash* sp_hash_table, void* upage, struct file* file,
   struct spt_entry *e;
   
   e = (struct spt_entry *) malloc(sizeof *e);
+  if (e == NULL)  return NULL;
 
   e->upage = upage;
   e->kpage = NULL;
@@ -78,65 +229,257 @@ init_file_spt_entry(struct hash* sp_hash_table, void* upage, struct file* file,
   e->read_bytes = read_bytes;
   e->padding = padding;
   e->writable = writable;
+  e->mmap = false;
+  e->shared = false;
+  e->cow = false;
+  e->locked = false;
   
   hash_insert(sp_hash_table, &e->hash_elem);
   
   return e;
 }
 
+/* Returns true if E is a page that is all zeros until written:
+   a zero-fill page, or a BSS page of an executable. */
 bool
-load_a_page(struct hash* sp_hash_table, void* upage)
+is_zero_page(struct spt_entry *e)
+{
+  return (e->state == ONLY_ZERO || e->state == IN_ZERO
+          || (e->state == IN_FILE && e->read_bytes == 0 && !e->mmap));
+}
+
+/* Brings in UPAGE after a fault.  WRITE tells whether the fault
+   was for a write; a zero-fill page that is only read is mapped
+   to the shared zero page rather than given a frame of its own. */
+bool
+load_a_page(struct hash* sp_hash_table, void* upage, bool write)
 {
   struct spt_entry* e;
-  e = get_spt_entry(sp_hash_table, upage);
+  e = fetch_spt_entry(sp_hash_table, upage);
   if (e == NULL)  exit (-1);
 
+  if (!write && is_zero_page(e))
+  {
+    if (!pagedir_set_page(thread_current()->pagedir, upage, falloc_zero_page(), false))
+      exit (-1);
+    e->state = IN_ZERO;
+    return true;
+  }
+
+  if (e->shared && e->state == IN_FILE)
+  {
+    if (!falloc_map_shared(e))  exit (-1);
+    return true;
+  }
+
   void* kpage;
   kpage = falloc_get_page(upage, PAL_USER);
   if (kpage == NULL)  exit (-1);
 
-  bool flag = false;
+  bool from_swap = e->state == IN_SWAP;
+  bool from_file = e->state == IN_FILE;
+  int swap_id = from_swap ? e->swap_id : -1;
 
   switch (e->state)
   {
   case ONLY_ZERO:
+  case IN_ZERO:
     memset (kpage, 0, PGSIZE);
     break;
   case IN_SWAP:
     swap_load(e, kpage);
     break;
   case IN_FILE:
-    if(!lock_held_by_current_thread(&file_lock))  {
-      lock_acquire(&file_lock);
-      flag = true;
-    }
     if (file_read_at(e->file, kpage, e->read_bytes, e->ofs) != e->read_bytes)
     {
       falloc_free_page (kpage);
-      lock_release (&file_lock);
       exit (-1);
     }
     memset (kpage + e->read_bytes, 0, e->padding);
-    if(flag) lock_release(&file_lock);
     break;
   default:
     exit (-1);
   }
 
-  uint32_t* pagedir = thread_current()->pagedir;
-
-  if (!pagedir_set_page(pagedir, upage, kpage, e->writable))
+  if (!map_frame(e, kpage, from_swap))
   {
     falloc_free_page(kpage);
     exit(-1);
   }
 
+  if (from_swap || from_file)
+    fault_around(sp_hash_table, e, swap_id);
+
+  return true;
+}
+
+/* Maps frame KPAGE, already filled in, at E's page in the running
+   process and unpins it.  FROM_SWAP tells whether KPAGE was read
+   from swap. */
+static bool
+map_frame(struct spt_entry *e, void *kpage, bool from_swap)
+{
+  uint32_t* pagedir = thread_current()->pagedir;
+
+  if (!pagedir_set_page(pagedir, e->upage, kpage, e->writable))
+    return false;
+
+  /* A page read back from swap has no other copy, so it must be
+     written out again if evicted even if it is not modified. */
+  if (from_swap)
+    pagedir_set_dirty(pagedir, e->upage, true);
+
   e->kpage = kpage;
   e->state = IN_FRAME;
-
+  falloc_unpin_page(kpage, e);
   return true;
 }
 
+/* After a fault on page E that had to be read in, also reads in
+   the other non-resident pages of the same file in the aligned
+   block of fault_around_pages pages around it, so that a
+   sequential scan takes one fault per block instead of one per
+   page.  If E came from swap slot SWAP_ID, also reads in the
+   pages of the block whose slots lie at the same distance from
+   SWAP_ID as the pages lie from E; these were swapped out
+   together, so the reads are contiguous on disk.  Stops early
+   rather than evict anything.
+
+   madvise() advice on E's VMA changes the window: none at all
+   for MADV_RANDOM, and for MADV_SEQUENTIAL the FAULT_AROUND_MAX
+   pages from E on, while the pages just behind E are marked
+   unused so that they are the first to be evicted. */
+static void
+fault_around(struct hash *spt, struct spt_entry *e, int swap_id)
+{
+  struct spt_entry *swapped[FAULT_AROUND_MAX];
+  void *kpages[FAULT_AROUND_MAX];
+  size_t swap_cnt = 0;
+  struct vma *v = vma_find(e->upage);
+  int advice = v != NULL ? v->advice : MADV_NORMAL;
+  size_t cnt = fault_around_pages;
+  uintptr_t base;
+  size_t i;
+
+  if (advice == MADV_RANDOM)
+    return;
+  if (advice == MADV_SEQUENTIAL)
+  {
+    cnt = FAULT_AROUND_MAX;
+    base = (uintptr_t) e->upage;
+    drop_behind(spt, e->upage, cnt);
+  }
+  else
+  {
+    if (cnt > FAULT_AROUND_MAX)
+      cnt = FAULT_AROUND_MAX;
+    if (cnt <= 1)
+      return;
+    base = (uintptr_t) e->upage / (cnt * PGSIZE) * (cnt * PGSIZE);
+  }
+  for (i = 0; i < cnt; i++)
+  {
+    void *upage = (void *) (base + i * PGSIZE);
+    struct spt_entry *n;
+    void *kpage;
+
+    if (upage == e->upage || !is_user_vaddr(upage))  continue;
+    n = get_spt_entry(spt, upage);
+    if (n == NULL)
+    {
+      /* Only make an entry for a page we are going to read. */
+      struct vma *v = vma_find(upage);
+      if (v == NULL || v->file != e->file || !vma_has_data(v, upage))
+        continue;
+      n = fetch_spt_entry(spt, upage);
+      if (n == NULL)  break;
+    }
+    if (n->state == IN_SWAP)
+    {
+      int dist = ((intptr_t) upage - (intptr_t) e->upage) / PGSIZE;
+      if (swap_id < 0 || n->swap_id != swap_id + dist)  continue;
+    }
+    else if (n->state != IN_FILE || is_zero_page(n) || n->file != e->file)
+      continue;
+    if (!falloc_has_spare())  break;
+
+    if (n->state == IN_FILE && n->shared)
+    {
+      if (!falloc_map_shared(n))  break;
+      fault_around_cnt++;
+      continue;
+    }
+
+    kpage = falloc_get_page(upage, PAL_USER);
+    if (kpage == NULL)  break;
+    if (n->state == IN_SWAP)
+    {
+      swapped[swap_cnt] = n;
+      kpages[swap_cnt++] = kpage;
+      continue;
+    }
+
+    if (file_read_at(n->file, kpage, n->read_bytes, n->ofs) != (off_t) n->read_bytes)
+    {
+      falloc_free_page(kpage);
+      break;
+    }
+    memset(kpage + n->read_bytes, 0, n->padding);
+    if (!map_frame(n, kpage, false))
+    {
+      falloc_free_page(kpage);
+      break;
+    }
+    fault_around_cnt++;
+  }
+
+  if (swap_cnt > 0)
+  {
+    swap_load_batch(swapped, kpages, swap_cnt);
+    for (i = 0; i < swap_cnt; i++)
+    {
+      if (map_frame(swapped[i], kpages[i], true))
+        fault_around_cnt++;
+      else
+      {
+        /* The slot is gone; keep the data with the page. */
+        swapped[i]->state = IN_FRAME;
+        swapped[i]->kpage = kpages[i];
+        exit (-1);
+      }
+    }
+  }
+}
+
+/* Marks the CNT pages just below UPAGE as not accessed, so that
+   a sequential scan evicts the pages it is done with before any
+   others. */
+static void
+drop_behind(struct hash *spt, void *upage, size_t cnt)
+{
+  uint32_t *pagedir = thread_current()->pagedir;
+  size_t i;
+
+  pagedir_batch_begin();
+  for (i = 1; i <= cnt && (uintptr_t) upage >= i * PGSIZE; i++)
+  {
+    struct spt_entry *n = get_spt_entry(spt, upage - i * PGSIZE);
+    if (n != NULL && n->state == IN_FRAME)
+      pagedir_set_accessed(pagedir, n->upage, false);
+  }
+  pagedir_batch_end();
+}
+
+/* Prints page fault statistics. */
+void
+page_print_stats(void)
+{
+  printf("Fault-around: %u pages mapped ahead, window %zu pages\n",
+         fault_around_cnt, fault_around_pages);
+  printf("Advice: %u pages read in, %u dropped\n",
+         willneed_cnt, dontneed_cnt);
+}
+
 struct spt_entry*
 get_spt_entry(struct hash* sp_hash_table, void* upage)
 {
@@ -148,9 +491,319 @@ get_spt_entry(struct hash* sp_hash_table, void* upage)
   return elem != NULL ? hash_entry(elem, struct spt_entry, hash_elem) : NULL;
 }
 
+/* Returns the running process's entry for UPAGE, first making
+   one from UPAGE's VMA if UPAGE has not been brought in before.
+   Returns NULL if UPAGE is not mapped or memory runs out. */
+struct spt_entry *
+fetch_spt_entry(struct hash *sp_hash_table, void *upage)
+{
+  struct spt_entry *e = get_spt_entry(sp_hash_table, upage);
+  struct vma *v;
+  uint32_t delta, read_bytes;
+
+  if (e != NULL)  return e;
+  v = vma_find(upage);
+  if (v == NULL)  return NULL;
+
+  if (v->file == NULL)
+  {
+    e = init_zero_spt_entry(sp_hash_table, upage);
+    if (e != NULL)  e->writable = v->writable;
+    return e;
+  }
+
+  delta = upage - v->start;
+  read_bytes = 0;
+  if (delta < v->read_bytes)
+    read_bytes = v->read_bytes - delta < PGSIZE ? v->read_bytes - delta : PGSIZE;
+  e = init_file_spt_entry(sp_hash_table, upage, v->file, v->ofs + delta, read_bytes, PGSIZE - read_bytes, v->writable);
+  if (e != NULL)
+  {
+    e->mmap = v->mmap;
+    e->shared = v->shared;
+  }
+  return e;
+}
+
 void 
 delete_a_page(struct hash *sp_hash_table, struct spt_entry *entry)
 {
   hash_delete(sp_hash_table, &entry->hash_elem);
+  falloc_release_page(entry);
+  if (entry->state == IN_SWAP)
+    swap_free(entry->swap_id);
+  else if (entry->state == IN_ZERO)
+    pagedir_clear_page(thread_current()->pagedir, entry->upage);
   free(entry);
-}
\ No newline at end of file
+}
+
+/* Checks that the LEN bytes at ADDR, rounded out to whole pages,
+   are all mapped in the running process, and stores the end of
+   the last page in *END.  A zero-length range is always valid. */
+static bool
+range_mapped(void *addr, size_t len, void **end)
+{
+  void *upage;
+
+  if (!is_user_vaddr(addr) || len > (size_t) (PHYS_BASE - addr))
+    return false;
+  *end = pg_round_up(addr + len);
+  for (upage = pg_round_down(addr); upage < *end; upage += PGSIZE)
+    if (vma_find(upage) == NULL)
+      return false;
+  return true;
+}
+
+/* Splits the running process's VMA V in two at page AT, which
+   must lie inside V, and returns the upper half.  Returns NULL
+   if memory runs out. */
+static struct vma *
+vma_split(struct vma *v, void *at)
+{
+  uint32_t delta = at - v->start;
+  struct vma *upper = malloc(sizeof *upper);
+  if (upper == NULL)  return NULL;
+
+  ASSERT(pg_ofs(at) == 0 && v->start < at && at < v->end);
+  *upper = *v;
+  upper->start = at;
+  upper->ofs = v->ofs + delta;
+  upper->read_bytes = v->read_bytes > delta ? v->read_bytes - delta : 0;
+  v->end = at;
+  if (v->read_bytes > delta)
+    v->read_bytes = delta;
+  avl_insert(&thread_current()->vm_areas, &upper->avl_elem);
+  return upper;
+}
+
+/* Gives the pages in [START, END) the fault-around ADVICE,
+   splitting VMAs that extend beyond the range. */
+static bool
+set_advice(void *start, void *end, int advice)
+{
+  struct vma *v = vma_find(start);
+
+  if (v->start < start && (v = vma_split(v, start)) == NULL)
+    return false;
+  for (; v != NULL && v->start < end; v = vma_find(v->end))
+  {
+    if (v->end > end && vma_split(v, end) == NULL)
+      return false;
+    v->advice = advice;
+  }
+  return true;
+}
+
+/* madvise(): applies ADVICE to the LEN bytes at page-aligned
+   ADDR, which must all be mapped.  MADV_WILLNEED reads in the
+   pages that are on disk, for as long as there are frames to
+   spare.  MADV_DONTNEED discards the pages, writing memory-mapped
+   ones back first, so that they read back as they started out;
+   locked pages are left alone.  Returns false on error. */
+bool
+advise_pages(void *addr, size_t len, int advice)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  void *end, *upage;
+
+  if (pg_ofs(addr) != 0 || !range_mapped(addr, len, &end))
+    return false;
+
+  switch (advice)
+  {
+  case MADV_NORMAL:
+  case MADV_SEQUENTIAL:
+  case MADV_RANDOM:
+    return addr == end || set_advice(addr, end, advice);
+
+  case MADV_WILLNEED:
+    for (upage = addr; upage < end; upage += PGSIZE)
+    {
+      struct spt_entry *e = get_spt_entry(spt, upage);
+      if (e == NULL ? !vma_has_data(vma_find(upage), upage)
+          : (e->state != IN_SWAP && e->state != IN_FILE) || is_zero_page(e))
+        continue;
+      if (!falloc_has_spare())  break;
+      load_a_page(spt, upage, false);
+      willneed_cnt++;
+    }
+    return true;
+
+  case MADV_DONTNEED:
+    for (upage = addr; upage < end; upage += PGSIZE)
+    {
+      struct spt_entry *e = get_spt_entry(spt, upage);
+      if (e == NULL || e->locked)  continue;
+      if (e->mmap)
+        falloc_write_back(e);
+      delete_a_page(spt, e);
+      dontneed_cnt++;
+    }
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+/* mlock(): brings in the pages that hold the LEN bytes at ADDR,
+   which must all be mapped, and keeps them in memory until
+   munlock().  Returns false on error, or if too many pages are
+   locked; the pages locked before that stay locked. */
+bool
+lock_pages(void *addr, size_t len)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  void *end, *upage;
+
+  if (!range_mapped(addr, len, &end))
+    return false;
+  for (upage = pg_round_down(addr); upage < end; upage += PGSIZE)
+  {
+    struct spt_entry *e = fetch_spt_entry(spt, upage);
+    if (e == NULL || !falloc_lock_page(e))
+      return false;
+  }
+  return true;
+}
+
+/* munlock(): lets the pages that hold the LEN bytes at ADDR,
+   which must all be mapped, be evicted again.  Returns false on
+   error. */
+bool
+unlock_pages(void *addr, size_t len)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  void *end, *upage;
+
+  if (!range_mapped(addr, len, &end))
+    return false;
+  for (upage = pg_round_down(addr); upage < end; upage += PGSIZE)
+  {
+    struct spt_entry *e = get_spt_entry(spt, upage);
+    if (e != NULL)
+      falloc_unlock_page(e);
+  }
+  return true;
+}
+
+/* Brings in and pins the running process's page UPAGE for a
+   system call, as pin_user_buffer() describes. */
+static bool
+pin_page(struct hash *spt, void *upage, bool write)
+{
+  struct spt_entry *e;
+
+  if (vma_find(upage) == NULL)
+  {
+    /* A buffer just below the stack extends the stack, as a fault
+       there would. */
+    uint8_t *esp = thread_current()->esp;
+    if ((size_t) (PHYS_BASE - upage) > MAX_STACK_SIZE
+        || (uint8_t *) upage + PGSIZE + 128 <= esp || !grow_stack(upage))
+      return false;
+  }
+
+  e = fetch_spt_entry(spt, upage);
+  if (e == NULL || (write && !e->writable))
+    return false;
+
+  /* The zero page is never evicted. */
+  if (!write && e->state == IN_ZERO)
+    return true;
+  return falloc_pin_user_page(e, write);
+}
+
+/* Unpins the running process's pages in [START, END). */
+static void
+unpin_pages(void *start, void *end)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  void *upage;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+  {
+    struct spt_entry *e = get_spt_entry(spt, upage);
+    if (e != NULL && e->state == IN_FRAME)
+      falloc_unpin_user_page(e);
+  }
+}
+
+/* Brings in and pins the pages holding the SIZE bytes at user
+   address BUFFER, so that a system call can copy to or from them
+   without faulting.  A fault while the file system holds its
+   locks would stall every other process behind the page's I/O,
+   or deadlock if evicting another page needed the same locks.
+   WRITE tells whether the kernel will write to BUFFER.  Returns
+   false, leaving nothing pinned, if BUFFER is not valid. */
+bool
+pin_user_buffer(const void *buffer, size_t size, bool write)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  void *start, *end, *upage;
+
+  if (size == 0)
+    return true;
+  if (!is_user_vaddr(buffer) || size > (size_t) (PHYS_BASE - buffer))
+    return false;
+
+  start = pg_round_down(buffer);
+  end = pg_round_up(buffer + size);
+  for (upage = start; upage < end; upage += PGSIZE)
+    if (!pin_page(spt, upage, write))
+    {
+      unpin_pages(start, upage);
+      return false;
+    }
+  return true;
+}
+
+/* Undoes pin_user_buffer(BUFFER, SIZE, ...). */
+void
+unpin_user_buffer(const void *buffer, size_t size)
+{
+  if (size > 0)
+    unpin_pages(pg_round_down(buffer), pg_round_up(buffer + size));
+}
+
+/* Copies PARENT's supplemental page table into the running
+   process's, for fork().  MAP_FILE, called with AUX, translates
+   each of the parent's files into the child's copy of it.
+   Resident pages are shared with the parent; see
+   falloc_fork_page(). */
+bool
+fork_SupplementalPageTable(struct thread *parent, struct file *(*map_file)(struct file *, void *), void *aux)
+{
+  struct hash *spt = &thread_current()->sp_table;
+  struct hash_iterator i;
+  struct avl_elem *a;
+
+  for (a = avl_first(&parent->vm_areas); a != NULL; a = avl_next(a))
+  {
+    struct vma *p = avl_entry(a, struct vma, avl_elem);
+    struct vma *c = (struct vma *) malloc(sizeof *c);
+    if (c == NULL)  return false;
+
+    *c = *p;
+    c->file = p->file != NULL ? map_file(p->file, aux) : NULL;
+    avl_insert(&thread_current()->vm_areas, &c->avl_elem);
+  }
+
+  hash_first(&i, &parent->sp_table);
+  while (hash_next(&i))
+  {
+    struct spt_entry *p = hash_entry(hash_cur(&i), struct spt_entry, hash_elem);
+    struct spt_entry *c = (struct spt_entry *) malloc(sizeof *c);
+    if (c == NULL)  return false;
+
+    *c = *p;
+    c->file = p->file != NULL ? map_file(p->file, aux) : NULL;
+    c->state = ONLY_ZERO;
+    c->kpage = NULL;
+    c->locked = false;
+    hash_insert(spt, &c->hash_elem);
+
+    if (!falloc_fork_page(parent, p, c))  return false;
+  }
+  return true;
+}
@@ -1,14 +1,30 @@
 #ifndef VM_PAGE_H
 #define VM_PAGE_H
 
+#include <avl.h>
 #include <hash.h>
 #include "filesys/file.h"
 #include "filesys/off_t.h"
 
+struct thread;
+
 #define ONLY_ZERO 0
 #define IN_FRAME 1
 #define IN_SWAP 2
 #define IN_FILE 3
+#define IN_ZERO 4   /* Mapped read-only to the shared zero page. */
+
+/* Paging advice for madvise(); must match lib/user/syscall.h. */
+#define MADV_NORMAL 0       /* Default fault-around. */
+#define MADV_SEQUENTIAL 1   /* Read far ahead, drop pages behind. */
+#define MADV_RANDOM 2       /* No fault-around. */
+#define MADV_WILLNEED 3     /* Read the pages in now. */
+#define MADV_DONTNEED 4     /* Discard the pages now. */
+
+/* Upper bound on fault_around_pages. */
+#define FAULT_AROUND_MAX 64
+
+extern size_t fault_around_pages;
 
 struct spt_entry
   {
@@ -22,19 +38,58 @@ struct spt_entry
     uint32_t padding;
     off_t ofs;
     bool writable;
+    bool mmap;          /* Backed by a memory-mapped file? */
+    bool shared;        /* Read-only executable page, shared? */
+    bool cow;           /* Shared copy-on-write since fork()? */
+    bool locked;        /* Held in memory by mlock()? */
     
     int swap_id;
 
     struct hash_elem hash_elem;
   };
 
+/* A virtual memory area: a range of pages with the same backing,
+   such as a segment of the executable, the stack, or a memory
+   mapping.  A page in a VMA has no spt_entry until it is first
+   brought in; until then it holds its initial contents, read
+   from FILE or zero-filled. */
+struct vma
+  {
+    struct avl_elem avl_elem;   /* Element in thread's vm_areas. */
+    void *start;                /* First page. */
+    void *end;                  /* Page after the last page. */
+    struct file *file;          /* Backing file, or null for zeros. */
+    off_t ofs;                  /* Offset of START in FILE. */
+    uint32_t read_bytes;        /* Bytes read from FILE; rest are zero. */
+    bool writable;
+    bool mmap;                  /* Memory-mapped file? */
+    bool shared;                /* Read-only executable pages? */
+    int advice;                 /* MADV_NORMAL, _SEQUENTIAL or _RANDOM. */
+  };
+
+void vma_init(struct avl *);
+struct vma *vma_add(void *start, size_t page_cnt, struct file *, off_t, uint32_t read_bytes, bool writable);
+struct vma *vma_find(const void *upage);
+bool vma_overlaps(const void *start, const void *end);
+void vma_remove(struct vma *);
+bool grow_stack(void *upage);
+
 void init_SupplementalPageTable(struct hash *);
 void destroy_SupplementalPageTable(struct hash *);
-void init_zero_spt_entry(struct hash *, void *);
+struct spt_entry *init_zero_spt_entry(struct hash *, void *);
 struct spt_entry *get_spt_entry(struct hash *, void *);
-void init_frame_spt_entry(struct hash *, void *, void *);
+struct spt_entry *fetch_spt_entry(struct hash *, void *);
+struct spt_entry *init_frame_spt_entry(struct hash *, void *, void *);
 struct spt_entry *init_file_spt_entry(struct hash *, void *, struct file *, off_t, uint32_t, uint32_t, bool);
-bool load_a_page(struct hash *, void *);
+bool load_a_page(struct hash *, void *, bool write);
+bool is_zero_page(struct spt_entry *);
 void delete_a_page(struct hash *spt, struct spt_entry *entry);
+bool advise_pages(void *, size_t, int advice);
+bool lock_pages(void *, size_t);
+bool unlock_pages(void *, size_t);
+bool pin_user_buffer(const void *, size_t, bool write);
+void unpin_user_buffer(const void *, size_t);
+bool fork_SupplementalPageTable(struct thread *parent, struct file *(*map_file)(struct file *, void *), void *aux);
+void page_print_stats(void);
 
 #endif
@@ -0,0 +1,290 @@
+#include "vm/policy.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+
+/* Page replacement policies.
+
+   The frame table tells the policy in use about every frame that
+   is given a page or freed, and asks it for a victim whenever it
+   has to evict.  A policy sees whether a page was used through
+   frame_test_and_clear_accessed(), which reads and clears the
+   page's accessed bits, and whether evicting it costs a write
+   through frame_is_dirty(). */
+
+static struct ft_entry *frames;     /* The frame table. */
+static size_t frame_cnt;
+static size_t hand;                 /* Next frame a clock looks at. */
+
+static void
+frames_init(struct ft_entry *frames_, size_t cnt)
+{
+  frames = frames_;
+  frame_cnt = cnt;
+  hand = 0;
+}
+
+static void
+no_op(struct ft_entry *f UNUSED)
+{
+}
+
+/* Clock: sweeps the frames in order, giving each recently used
+   page a second chance. */
+static struct ft_entry *
+clock_choose(void)
+{
+  size_t i;
+
+  /* Two sweeps are enough: the first clears every accessed bit. */
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct ft_entry *f = &frames[hand];
+    hand = (hand + 1) % frame_cnt;
+
+    if (f->t == NULL || f->pinned)
+      continue;
+    if (!frame_test_and_clear_accessed(f))
+      return f;
+  }
+  return NULL;
+}
+
+/* WSClock: like clock, but a page stays in its process's working
+   set until WS_WINDOW ticks pass without it being used, and a
+   clean page is preferred to a dirty one, which costs a write.
+   Dirty pages are only evicted when every candidate is dirty. */
+#define WS_WINDOW (TIMER_FREQ / 4)
+
+static void
+wsclock_add(struct ft_entry *f)
+{
+  f->last_use = timer_ticks();
+}
+
+static struct ft_entry *
+wsclock_choose(void)
+{
+  int64_t now = timer_ticks();
+  struct ft_entry *dirty = NULL;
+  size_t i;
+
+  /* The first sweep takes only pages outside the working set;
+     the second takes any page not used since the first. */
+  for (i = 0; i < 2 * frame_cnt; i++) {
+    struct ft_entry *f = &frames[hand];
+    hand = (hand + 1) % frame_cnt;
+
+    if (f->t == NULL || f->pinned)
+      continue;
+    if (frame_test_and_clear_accessed(f)) {
+      f->last_use = now;
+      continue;
+    }
+    if (frame_is_dirty(f)) {
+      if (dirty == NULL)
+        dirty = f;
+      continue;
+    }
+    if (i >= frame_cnt || now - f->last_use > WS_WINDOW)
+      return f;
+  }
+  return dirty;
+}
+
+/* 2Q: a page brought in for the first time joins the A1in FIFO,
+   and is evicted from there unless it is faulted in again soon
+   after, while it is still remembered in the A1out ghost list;
+   then it joins Am, which is managed by clock.  A page used only
+   in one burst, as by a large sequential scan, thus never
+   displaces the pages in Am, which are used again and again.
+   A1in is kept to about a quarter of the frames, and A1out
+   remembers half as many pages as there are frames, in a ring
+   indexed by a hash table so that looking a page up on every
+   allocation takes constant time. */
+enum twoq_queue
+  {
+    Q_NONE,
+    Q_A1IN,
+    Q_AM
+  };
+
+/* A page evicted from A1in.  Its owner is identified by thread
+   id rather than by pointer, because thread ids are never
+   reused, so a new process cannot inherit an exited one's
+   ghosts. */
+struct ghost
+  {
+    struct hash_elem elem;          /* Element in ghosts, if live. */
+    bool live;                      /* In ghosts? */
+    tid_t tid;                      /* Owner. */
+    void *upage;
+  };
+
+static struct list a1in, am;
+static size_t a1in_cnt, a1in_max;
+static struct ghost *a1out;         /* Ring of a1out_max ghosts. */
+static size_t a1out_max, a1out_next;
+static struct hash ghosts;          /* Live ghosts in a1out. */
+
+static unsigned
+ghost_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct ghost *g = hash_entry(e, struct ghost, elem);
+  return hash_bytes(&g->upage, sizeof g->upage) ^ hash_int(g->tid);
+}
+
+static bool
+ghost_less(const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct ghost *a = hash_entry(a_, struct ghost, elem);
+  const struct ghost *b = hash_entry(b_, struct ghost, elem);
+  return a->tid != b->tid ? a->tid < b->tid : a->upage < b->upage;
+}
+
+static void
+twoq_init(struct ft_entry *frames_, size_t cnt)
+{
+  frames_init(frames_, cnt);
+  list_init(&a1in);
+  list_init(&am);
+  a1in_cnt = 0;
+  a1in_max = cnt / 4 + 1;
+  a1out_max = cnt / 2 + 1;
+  a1out_next = 0;
+  a1out = calloc(a1out_max, sizeof *a1out);
+  if (a1out == NULL || !hash_init(&ghosts, ghost_hash, ghost_less, NULL))
+    PANIC("2Q: out of memory");
+}
+
+/* Forgets the ghost of page UPAGE of T, if there is one.
+   Returns true if there was. */
+static bool
+ghost_take(struct thread *t, void *upage)
+{
+  struct ghost key;
+  struct hash_elem *e;
+
+  key.tid = t->tid;
+  key.upage = upage;
+  e = hash_delete(&ghosts, &key.elem);
+  if (e == NULL)
+    return false;
+  hash_entry(e, struct ghost, elem)->live = false;
+  return true;
+}
+
+/* Takes frame F, being evicted from A1in, and remembers its
+   page in A1out. */
+static struct ft_entry *
+ghost_put(struct ft_entry *f)
+{
+  struct ghost *g = &a1out[a1out_next];
+  struct hash_elem *old;
+
+  a1out_next = (a1out_next + 1) % a1out_max;
+  if (g->live)
+    hash_delete(&ghosts, &g->elem);
+  g->tid = f->t->tid;
+  g->upage = f->upage;
+  g->live = true;
+  old = hash_replace(&ghosts, &g->elem);
+  if (old != NULL)
+    hash_entry(old, struct ghost, elem)->live = false;
+  return f;
+}
+
+static void
+twoq_add(struct ft_entry *f)
+{
+  if (ghost_take(f->t, f->upage)) {
+    list_push_back(&am, &f->q_elem);
+    f->queue = Q_AM;
+  }
+  else {
+    list_push_back(&a1in, &f->q_elem);
+    f->queue = Q_A1IN;
+    a1in_cnt++;
+  }
+}
+
+static void
+twoq_remove(struct ft_entry *f)
+{
+  if (f->queue == Q_NONE)
+    return;
+  list_remove(&f->q_elem);
+  if (f->queue == Q_A1IN)
+    a1in_cnt--;
+  f->queue = Q_NONE;
+}
+
+/* Returns the oldest unpinned frame in A1in, or a null pointer. */
+static struct ft_entry *
+a1in_oldest(void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin(&a1in); e != list_end(&a1in); e = list_next(e)) {
+    struct ft_entry *f = list_entry(e, struct ft_entry, q_elem);
+    if (!f->pinned)
+      return f;
+  }
+  return NULL;
+}
+
+static struct ft_entry *
+twoq_choose(void)
+{
+  struct ft_entry *f;
+  size_t i, n;
+
+  if (a1in_cnt > a1in_max || list_empty(&am)) {
+    f = a1in_oldest();
+    if (f != NULL)
+      return ghost_put(f);
+  }
+
+  /* Clock over Am, rotating the list instead of moving a hand. */
+  n = 2 * list_size(&am);
+  for (i = 0; i < n; i++) {
+    f = list_entry(list_pop_front(&am), struct ft_entry, q_elem);
+    list_push_back(&am, &f->q_elem);
+    if (!f->pinned && !frame_test_and_clear_accessed(f))
+      return f;
+  }
+
+  f = a1in_oldest();
+  return f != NULL ? ghost_put(f) : NULL;
+}
+
+static const struct replace_policy policies[] =
+  {
+    {"clock", frames_init, no_op, no_op, clock_choose},
+    {"wsclock", frames_init, wsclock_add, no_op, wsclock_choose},
+    {"2q", twoq_init, twoq_add, twoq_remove, twoq_choose},
+  };
+
+/* The policy in use. */
+const struct replace_policy *replace_policy = &policies[0];
+
+/* Makes the policy called NAME the one in use.  Must be called
+   before the frame table is initialized.  Returns true if
+   successful, false if there is no such policy. */
+bool
+replace_policy_select(const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp(policies[i].name, name)) {
+      replace_policy = &policies[i];
+      return true;
+    }
+  return false;
+}
@@ -0,0 +1,33 @@
+#ifndef VM_POLICY_H
+#define VM_POLICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct ft_entry;
+
+/* A page replacement policy.  The frame table calls these with
+   its lock held. */
+struct replace_policy
+  {
+    const char *name;
+
+    /* Called once, with the CNT entries of the frame table. */
+    void (*init) (struct ft_entry *frames, size_t cnt);
+
+    /* Frame F has just been given a page. */
+    void (*add) (struct ft_entry *f);
+
+    /* Frame F is about to be freed. */
+    void (*remove) (struct ft_entry *f);
+
+    /* Returns a frame to evict, in use and not pinned, or a null
+       pointer if there is none. */
+    struct ft_entry *(*choose) (void);
+  };
+
+extern const struct replace_policy *replace_policy;
+
+bool replace_policy_select (const char *name);
+
+#endif /* vm/policy.h */
@@ -1,5 +1,7 @@
 #include "vm/swap.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "vm/zswap.h"
 
 #define SECTORS_IN_PAGE (PGSIZE/BLOCK_SECTOR_SIZE)
 
@@ -7,39 +9,170 @@ static struct lock swap_lock;
 static struct bitmap *SwapTable;
 static struct block *swap_disk;
 
+/* Number of supplemental page table entries referring to each
+   slot.  A slot is shared after fork() and freed when its last
+   reference goes away. */
+static uint8_t *swap_ref_cnt;
+
+/* Slot after the last run handed out.  Slots are allocated
+   next-fit from here, so that pages evicted one after another
+   also end up next to each other on disk. */
+static size_t next_slot;
+
 void init_SwapTable()
 {
     lock_init(&swap_lock);
 
     swap_disk = block_get_role(BLOCK_SWAP);
     SwapTable = bitmap_create(block_size(swap_disk) / SECTORS_IN_PAGE);
+    swap_ref_cnt = calloc(bitmap_size(SwapTable), sizeof *swap_ref_cnt);
 
     bitmap_set_all(SwapTable, true);
+    zswap_init(swap_disk, bitmap_size(SwapTable));
+}
+
+/* Drops a reference to slot ID, freeing it if it was the last.
+   Must be called with swap_lock held. */
+static void swap_unref(int id)
+{
+    if (id >= bitmap_size(SwapTable) || id < 0)    exit(-1);
+    if (bitmap_test(SwapTable, id) == true)  exit(-1);
+
+    if (--swap_ref_cnt[id] == 0) {
+        zswap_invalidate(id);
+        bitmap_set(SwapTable, id, true);
+    }
 }
 
 void swap_load(struct spt_entry *spt_entry, void *kpage)
 {
+    if (!zswap_load(spt_entry->swap_id, kpage)) {
+        struct block_iovec iov = { kpage, PGSIZE };
+        block_read_multiple(swap_disk, spt_entry->swap_id * SECTORS_IN_PAGE, &iov, 1);
+    }
+
+    /* Drop our reference only after the read, so that the slot
+       cannot be reused and overwritten underneath it. */
     lock_acquire(&swap_lock);
+    swap_unref(spt_entry->swap_id);
+    lock_release(&swap_lock);
+}
 
-    if (spt_entry->swap_id >= bitmap_size(SwapTable) || spt_entry->swap_id < 0)    exit(-1);
-    if (bitmap_test(SwapTable, spt_entry->swap_id) == true)  exit(-1);
+/* Reads the CNT swapped-out pages PAGES[] into frames KPAGES[].
+   Pages not in the compressed cache are read from disk, with all
+   the reads submitted at once, so that the disk's I/O scheduler
+   can merge reads of adjacent slots, and then awaited together. */
+void swap_load_batch(struct spt_entry *pages[], void *kpages[], size_t cnt)
+{
+    struct block_request *reqs = malloc(cnt * sizeof *reqs);
+    struct block_request **req_ptrs = malloc(cnt * sizeof *req_ptrs);
+    struct block_iovec *iovs = malloc(cnt * sizeof *iovs);
+    size_t i;
 
-    bitmap_set(SwapTable, spt_entry->swap_id, true);
+    if (reqs == NULL || req_ptrs == NULL || iovs == NULL) {
+        for (i = 0; i < cnt; i++)
+            swap_load(pages[i], kpages[i]);
+    } else {
+        size_t req_cnt = 0;
 
-    lock_release(&swap_lock);
+        /* A null buffer marks a page found in the cache. */
+        for (i = 0; i < cnt; i++) {
+            iovs[i].buffer = zswap_load(pages[i]->swap_id, kpages[i]) ? NULL : kpages[i];
+            iovs[i].size = PGSIZE;
+        }
 
-    for(int i = 0; i < SECTORS_IN_PAGE; i++) block_read(swap_disk, spt_entry->swap_id * SECTORS_IN_PAGE + i, kpage + (i * BLOCK_SECTOR_SIZE));
+        /* Pages in consecutive slots are read with one request. */
+        for (i = 0; i < cnt; ) {
+            size_t run = 1;
+            if (iovs[i].buffer == NULL) {
+                i++;
+                continue;
+            }
+            while (i + run < cnt && iovs[i + run].buffer != NULL
+                   && pages[i + run]->swap_id == pages[i]->swap_id + (int) run)
+                run++;
+            block_submit(swap_disk, &reqs[req_cnt], pages[i]->swap_id * SECTORS_IN_PAGE,
+                         &iovs[i], run, false, NULL, NULL);
+            req_ptrs[req_cnt] = &reqs[req_cnt];
+            req_cnt++;
+            i += run;
+        }
+        block_wait_n(req_ptrs, req_cnt, req_cnt);
+
+        lock_acquire(&swap_lock);
+        for (i = 0; i < cnt; i++)
+            swap_unref(pages[i]->swap_id);
+        lock_release(&swap_lock);
+    }
+
+    free(reqs);
+    free(req_ptrs);
+    free(iovs);
 }
 
 int swap_evict(void *kpage)
 {
-    int id;
+    int id = swap_evict_run(&kpage, 1);
+    if (id < 0)
+        PANIC("swap_evict: out of swap space");
+    return id;
+}
+
+/* Writes the CNT pages in frames KPAGES[], at most SWAP_CLUSTER,
+   to a run of CNT consecutive free slots.  Pages that compress
+   well are kept in the compressed cache; the others are written
+   to disk, consecutive ones with a single request.  Returns the
+   first slot of the run; the Ith page is in slot first + I.
+   Returns -1 if there is no such run. */
+int swap_evict_run(void *kpages[], size_t cnt)
+{
+    struct block_iovec iovs[SWAP_CLUSTER];
+    size_t id, i;
+
+    ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
 
     lock_acquire(&swap_lock);
-    id = bitmap_scan_and_flip(SwapTable, 0, 1, true);
+    id = bitmap_scan_and_flip(SwapTable, next_slot, cnt, true);
+    if (id == BITMAP_ERROR)
+        id = bitmap_scan_and_flip(SwapTable, 0, cnt, true);
+    if (id == BITMAP_ERROR) {
+        lock_release(&swap_lock);
+        return -1;
+    }
+    for (i = 0; i < cnt; i++)
+        swap_ref_cnt[id + i] = 1;
+    next_slot = id + cnt;
     lock_release(&swap_lock);
 
-    for(int i = 0; i < SECTORS_IN_PAGE; ++i)    block_write(swap_disk, id * SECTORS_IN_PAGE + i, kpage + (BLOCK_SECTOR_SIZE * i));
+    for (i = 0; i < cnt; ) {
+        size_t run = 0;
+        while (i + run < cnt && !zswap_store(id + i + run, kpages[i + run])) {
+            iovs[run].buffer = kpages[i + run];
+            iovs[run].size = PGSIZE;
+            run++;
+        }
+        if (run > 0)
+            block_write_multiple(swap_disk, (id + i) * SECTORS_IN_PAGE, iovs, run);
+        i += run > 0 ? run : 1;
+    }
 
     return id;
 }
+
+/* Adds a reference to slot ID, for a page copied by fork(). */
+void swap_dup(int id)
+{
+    lock_acquire(&swap_lock);
+    ASSERT(!bitmap_test(SwapTable, id) && swap_ref_cnt[id] < UINT8_MAX);
+    swap_ref_cnt[id]++;
+    lock_release(&swap_lock);
+}
+
+/* Drops a reference to slot ID without reading it, for a page
+   discarded while swapped out. */
+void swap_free(int id)
+{
+    lock_acquire(&swap_lock);
+    swap_unref(id);
+    lock_release(&swap_lock);
+}
@@ -6,8 +6,15 @@
 #include "threads/vaddr.h"
 #include "vm/page.h"
 
+/* Most pages swap_evict_run() writes at once. */
+#define SWAP_CLUSTER 8
+
 void init_SwapTable();
 void swap_load(struct spt_entry *page, void *kva);
+void swap_load_batch(struct spt_entry *pages[], void *kvas[], size_t cnt);
 int swap_evict(void *kva);
+int swap_evict_run(void *kvas[], size_t cnt);
+void swap_dup(int id);
+void swap_free(int id);
 
 #endif
\ No newline at end of file
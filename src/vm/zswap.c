@@ -0,0 +1,322 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+#define SECTORS_IN_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The pool is handed out in chunks of CHUNK_SIZE bytes.  A page
+   is only kept if it compresses to at most MAX_STORED bytes;
+   anything larger saves too little to be worth the CPU time and
+   goes to disk instead. */
+#define CHUNK_SIZE 64
+#define MAX_STORED (PGSIZE * 3 / 4)
+
+/* Pages of kernel memory for compressed pages.  0 disables the
+   cache.  Set with -zswap. */
+size_t zswap_pool_pages = 32;
+
+/* A compressed page. */
+struct zswap_entry
+  {
+    struct list_elem lru_elem;      /* Element in lru. */
+    int slot;                       /* Swap slot it stands in for. */
+    size_t chunk;                   /* First chunk in pool. */
+    size_t len;                     /* Compressed size in bytes. */
+  };
+
+/* Everything below is protected by zswap_lock, which is held
+   across the disk write of a page being written back, so that a
+   page is always either in the cache or on disk. */
+static struct lock zswap_lock;
+static struct block *swap_disk;
+static uint8_t *pool;                   /* zswap_pool_pages pages. */
+static struct bitmap *chunk_map;        /* Chunks of pool in use. */
+static struct zswap_entry **entries;    /* By swap slot, or null. */
+static struct list lru;                 /* Least recently used first. */
+static uint8_t *scratch;                /* Compression output. */
+static uint8_t *bounce;                 /* Decompressed write-backs. */
+
+/* Statistics. */
+static unsigned store_cnt;              /* Pages compressed and kept. */
+static unsigned reject_cnt;             /* Pages sent to disk instead. */
+static unsigned hit_cnt;                /* Loads served from the cache. */
+static unsigned miss_cnt;               /* Loads that went to disk. */
+static unsigned writeback_cnt;          /* Pages pushed out to disk. */
+static unsigned long long stored_bytes; /* Compressed size of stores. */
+
+/* A small LZ77 compressor for whole pages.  The output is a
+   sequence of items, each starting with a control byte C: if C
+   is below 0x80, C + 1 literal bytes follow; otherwise the item
+   is a match of (C & 0x7f) + LZ_MIN_MATCH bytes copied from a
+   distance given by the next two bytes, little-endian. */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_HASH_BITS 12
+
+/* Last position + 1 of each 3-byte hash, or 0. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static unsigned
+lz_hash(const uint8_t *p)
+{
+  uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the CNT literal bytes at SRC to DST, which holds *OP of
+   CAP bytes.  Returns false if they do not fit. */
+static bool
+lz_literals(const uint8_t *src, size_t cnt, uint8_t *dst, size_t *op,
+            size_t cap)
+{
+  while (cnt > 0) {
+    size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+    if (*op + 1 + run > cap)
+      return false;
+    dst[(*op)++] = run - 1;
+    memcpy(dst + *op, src, run);
+    *op += run;
+    src += run;
+    cnt -= run;
+  }
+  return true;
+}
+
+/* Compresses page SRC into DST, which has room for CAP bytes.
+   Returns the compressed size, or 0 if it would exceed CAP. */
+static size_t
+lz_compress(const uint8_t *src, uint8_t *dst, size_t cap)
+{
+  size_t ip = 0, lit = 0, op = 0;
+
+  memset(lz_table, 0, sizeof lz_table);
+  while (ip + LZ_MIN_MATCH <= PGSIZE) {
+    unsigned h = lz_hash(src + ip);
+    size_t cand = lz_table[h];
+
+    lz_table[h] = ip + 1;
+    if (cand != 0 && memcmp(src + cand - 1, src + ip, LZ_MIN_MATCH) == 0) {
+      size_t from = cand - 1;
+      size_t len = LZ_MIN_MATCH;
+      size_t dist = ip - from;
+
+      while (ip + len < PGSIZE && len < LZ_MAX_MATCH
+             && src[from + len] == src[ip + len])
+        len++;
+      if (!lz_literals(src + lit, ip - lit, dst, &op, cap) || op + 3 > cap)
+        return 0;
+      dst[op++] = 0x80 | (len - LZ_MIN_MATCH);
+      dst[op++] = dist & 0xff;
+      dst[op++] = dist >> 8;
+      ip += len;
+      lit = ip;
+    }
+    else
+      ip++;
+  }
+  if (!lz_literals(src + lit, PGSIZE - lit, dst, &op, cap))
+    return 0;
+  return op;
+}
+
+/* Decompresses the LEN bytes at SRC into page DST. */
+static void
+lz_decompress(const uint8_t *src, size_t len, uint8_t *dst)
+{
+  size_t ip = 0, op = 0;
+
+  while (ip < len) {
+    uint8_t c = src[ip++];
+    if (c < 0x80) {
+      size_t run = c + 1;
+      ASSERT(ip + run <= len && op + run <= PGSIZE);
+      memcpy(dst + op, src + ip, run);
+      ip += run;
+      op += run;
+    }
+    else {
+      size_t mlen = (c & 0x7f) + LZ_MIN_MATCH;
+      size_t dist;
+      ASSERT(ip + 2 <= len);
+      dist = src[ip] | src[ip + 1] << 8;
+      ip += 2;
+      ASSERT(dist > 0 && dist <= op && op + mlen <= PGSIZE);
+      /* Byte by byte, since the source may overlap the output. */
+      for (; mlen > 0; mlen--, op++)
+        dst[op] = dst[op - dist];
+    }
+  }
+  ASSERT(op == PGSIZE);
+}
+
+/* Sets up the cache in front of the SLOT_CNT slots of swap
+   device DISK, taking zswap_pool_pages pages from the kernel
+   pool. */
+void
+zswap_init(struct block *disk, size_t slot_cnt)
+{
+  lock_init(&zswap_lock);
+  list_init(&lru);
+  swap_disk = disk;
+  if (zswap_pool_pages == 0)
+    return;
+
+  pool = palloc_get_multiple(0, zswap_pool_pages);
+  scratch = palloc_get_page(0);
+  bounce = palloc_get_page(0);
+  chunk_map = bitmap_create(zswap_pool_pages * PGSIZE / CHUNK_SIZE);
+  entries = calloc(slot_cnt, sizeof *entries);
+  if (pool == NULL || scratch == NULL || bounce == NULL
+      || chunk_map == NULL || entries == NULL)
+    PANIC("zswap_init: out of memory for a %zu page pool",
+          zswap_pool_pages);
+}
+
+/* Drops entry Z.  Must be called with zswap_lock held. */
+static void
+free_entry(struct zswap_entry *z)
+{
+  bitmap_set_multiple(chunk_map, z->chunk, DIV_ROUND_UP(z->len, CHUNK_SIZE),
+                      false);
+  list_remove(&z->lru_elem);
+  entries[z->slot] = NULL;
+  free(z);
+}
+
+/* Writes the least recently used page out to its slot on disk
+   and drops it from the cache.  Returns false if the cache is
+   empty.  Must be called with zswap_lock held. */
+static bool
+writeback_lru(void)
+{
+  struct zswap_entry *z;
+  struct block_iovec iov = { bounce, PGSIZE };
+
+  if (list_empty(&lru))
+    return false;
+  z = list_entry(list_front(&lru), struct zswap_entry, lru_elem);
+  lz_decompress(pool + z->chunk * CHUNK_SIZE, z->len, bounce);
+  block_write_multiple(swap_disk, z->slot * SECTORS_IN_PAGE, &iov, 1);
+  free_entry(z);
+  writeback_cnt++;
+  return true;
+}
+
+/* Tries to keep page KPAGE, which belongs in swap slot SLOT, in
+   the cache, writing older pages back to disk to make room if
+   needed.  Returns false if the page does not compress well
+   enough, in which case the caller must write it to disk. */
+bool
+zswap_store(int slot, const void *kpage)
+{
+  struct zswap_entry *z;
+  size_t len, chunk;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire(&zswap_lock);
+  ASSERT(entries[slot] == NULL);
+  len = lz_compress(kpage, scratch, MAX_STORED);
+  z = len != 0 ? malloc(sizeof *z) : NULL;
+  if (z == NULL) {
+    reject_cnt++;
+    lock_release(&zswap_lock);
+    return false;
+  }
+
+  while ((chunk = bitmap_scan_and_flip(chunk_map, 0,
+                                       DIV_ROUND_UP(len, CHUNK_SIZE), false))
+         == BITMAP_ERROR)
+    if (!writeback_lru()) {
+      free(z);
+      reject_cnt++;
+      lock_release(&zswap_lock);
+      return false;
+    }
+
+  memcpy(pool + chunk * CHUNK_SIZE, scratch, len);
+  z->slot = slot;
+  z->chunk = chunk;
+  z->len = len;
+  entries[slot] = z;
+  list_push_back(&lru, &z->lru_elem);
+  store_cnt++;
+  stored_bytes += len;
+  lock_release(&zswap_lock);
+  return true;
+}
+
+/* Reads the page for swap slot SLOT into KPAGE if it is in the
+   cache.  Returns false if it is not, in which case it is on
+   disk.  The page stays cached until zswap_invalidate(), since
+   the slot may be shared after fork(). */
+bool
+zswap_load(int slot, void *kpage)
+{
+  struct zswap_entry *z;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire(&zswap_lock);
+  z = entries[slot];
+  if (z == NULL) {
+    miss_cnt++;
+    lock_release(&zswap_lock);
+    return false;
+  }
+  lz_decompress(pool + z->chunk * CHUNK_SIZE, z->len, kpage);
+  list_remove(&z->lru_elem);
+  list_push_back(&lru, &z->lru_elem);
+  hit_cnt++;
+  lock_release(&zswap_lock);
+  return true;
+}
+
+/* Forgets any cached copy of swap slot SLOT, which is being
+   freed. */
+void
+zswap_invalidate(int slot)
+{
+  if (pool == NULL)
+    return;
+
+  lock_acquire(&zswap_lock);
+  if (entries[slot] != NULL)
+    free_entry(entries[slot]);
+  lock_release(&zswap_lock);
+}
+
+/* Prints compressed swap cache statistics. */
+void
+zswap_print_stats(void)
+{
+  unsigned loads = hit_cnt + miss_cnt;
+  unsigned long long ratio = stored_bytes != 0
+    ? (unsigned long long) store_cnt * PGSIZE * 100 / stored_bytes : 0;
+
+  if (pool == NULL)
+    return;
+  printf("Zswap: %zu of %zu pages in use, %zu pages held, "
+         "%u stored, %u rejected, %u written back\n",
+         DIV_ROUND_UP(bitmap_count(chunk_map, 0, bitmap_size(chunk_map), true)
+                      * CHUNK_SIZE, PGSIZE),
+         zswap_pool_pages, list_size(&lru),
+         store_cnt, reject_cnt, writeback_cnt);
+  printf("Zswap: %u hits, %u misses (%u%% hit rate), "
+         "compression ratio %llu.%02llu\n",
+         hit_cnt, miss_cnt, loads != 0 ? hit_cnt * 100 / loads : 0,
+         ratio / 100, ratio % 100);
+}
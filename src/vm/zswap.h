@@ -0,0 +1,21 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache.  Sits in front of the swap disk and
+   keeps compressed copies of swapped-out pages in a fixed pool of
+   kernel memory, keyed by swap slot. */
+
+struct block;
+
+extern size_t zswap_pool_pages;
+
+void zswap_init(struct block *swap_disk, size_t slot_cnt);
+bool zswap_store(int slot, const void *kpage);
+bool zswap_load(int slot, void *kpage);
+void zswap_invalidate(int slot);
+void zswap_print_stats(void);
+
+#endif